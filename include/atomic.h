@@ -0,0 +1,176 @@
+#ifndef __ATOMIC_H__
+#define __ATOMIC_H__
+
+#include "types.h"
+
+/*
+ * Atomics on 32-bit words, built directly on the A extension.
+ *
+ * Read-modify-write operations are single amo*.w instructions; compare
+ * and swap is an lr.w/sc.w loop. Every operation comes in four orderings:
+ *
+ *   atomic_op_relaxed()  atomicity only
+ *   atomic_op_acquire()  later accesses stay after it        (.aq)
+ *   atomic_op_release()  earlier accesses stay before it     (.rl)
+ *   atomic_op()          both, fully ordered                 (.aqrl)
+ *
+ * Pick the weakest one that is correct: a statistics counter wants
+ * _relaxed, a lock acquire _acquire, a lock release _release. Pointers
+ * and enums are 32 bits on rv32 and go through atomic_xchg_ptr() and
+ * atomic_cas().
+ */
+
+/* -------------------------------------------------------------------------- */
+/*                                   Fences                                   */
+/* -------------------------------------------------------------------------- */
+
+/* Compiler barrier only: no instruction, just no reordering across it */
+#define barrier() asm volatile("" ::: "memory")
+
+/* Full fence between memory accesses on either side */
+static inline void smp_mb(void)
+{
+    asm volatile("fence rw, rw" ::: "memory");
+}
+
+/* Loads before it complete before loads after it */
+static inline void smp_rmb(void)
+{
+    asm volatile("fence r, r" ::: "memory");
+}
+
+/* Stores before it are visible before stores after it */
+static inline void smp_wmb(void)
+{
+    asm volatile("fence w, w" ::: "memory");
+}
+
+/* Turns a preceding load into an acquire */
+static inline void smp_acquire(void)
+{
+    asm volatile("fence r, rw" ::: "memory");
+}
+
+/* Turns a following store into a release */
+static inline void smp_release(void)
+{
+    asm volatile("fence rw, w" ::: "memory");
+}
+
+/* Memory stores (e.g. a framebuffer) land before later device I/O writes */
+static inline void io_wmb(void)
+{
+    asm volatile("fence w, o" ::: "memory");
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                Load / Store                                */
+/* -------------------------------------------------------------------------- */
+
+static inline uint32_t atomic_load_relaxed(const volatile uint32_t *p)
+{
+    return *p;
+}
+
+static inline uint32_t atomic_load_acquire(const volatile uint32_t *p)
+{
+    uint32_t v = *p;
+    smp_acquire();
+    return v;
+}
+
+static inline void atomic_store_relaxed(volatile uint32_t *p, uint32_t v)
+{
+    *p = v;
+}
+
+static inline void atomic_store_release(volatile uint32_t *p, uint32_t v)
+{
+    smp_release();
+    *p = v;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              Read-Modify-Write                             */
+/* -------------------------------------------------------------------------- */
+
+/* Each returns the value *p held before the operation */
+#define ATOMIC_AMO(op, insn, ord, sfx)                                  \
+    static inline uint32_t atomic_##op##ord(volatile uint32_t *p,       \
+                                            uint32_t v)                 \
+    {                                                                   \
+        uint32_t old;                                                   \
+        asm volatile(insn sfx " %1, %2, %0"                             \
+                     : "+A"(*p), "=r"(old)                              \
+                     : "r"(v)                                           \
+                     : "memory");                                       \
+        return old;                                                     \
+    }
+
+#define ATOMIC_AMO_ORDERS(op, insn)          \
+    ATOMIC_AMO(op, insn, _relaxed, "")       \
+    ATOMIC_AMO(op, insn, _acquire, ".aq")    \
+    ATOMIC_AMO(op, insn, _release, ".rl")    \
+    ATOMIC_AMO(op, insn, , ".aqrl")
+
+ATOMIC_AMO_ORDERS(fetch_add, "amoadd.w")
+ATOMIC_AMO_ORDERS(fetch_and, "amoand.w")
+ATOMIC_AMO_ORDERS(fetch_or, "amoor.w")
+ATOMIC_AMO_ORDERS(fetch_maxu, "amomaxu.w")
+ATOMIC_AMO_ORDERS(xchg, "amoswap.w")
+
+#undef ATOMIC_AMO_ORDERS
+#undef ATOMIC_AMO
+
+/* Subtraction is an add of the two's complement; there is no amosub */
+#define atomic_fetch_sub_relaxed(p, v) atomic_fetch_add_relaxed(p, -(v))
+#define atomic_fetch_sub_acquire(p, v) atomic_fetch_add_acquire(p, -(v))
+#define atomic_fetch_sub_release(p, v) atomic_fetch_add_release(p, -(v))
+#define atomic_fetch_sub(p, v) atomic_fetch_add(p, -(v))
+
+/**
+ * @brief Compare and swap: store new if *p still holds old.
+ *
+ * @return The value *p held; equal to old exactly when the swap happened.
+ */
+#define ATOMIC_CMPXCHG(ord, lr, sc)                                      \
+    static inline uint32_t atomic_cmpxchg##ord(                          \
+        volatile uint32_t *p, uint32_t old, uint32_t new)                \
+    {                                                                    \
+        uint32_t prev, fail;                                             \
+        asm volatile("0: " lr " %0, %2\n"                                \
+                     "   bne %0, %3, 1f\n"                               \
+                     "   " sc " %1, %4, %2\n"                            \
+                     "   bnez %1, 0b\n"                                  \
+                     "1:\n"                                              \
+                     : "=&r"(prev), "=&r"(fail), "+A"(*p)                \
+                     : "r"(old), "r"(new)                                \
+                     : "memory");                                        \
+        return prev;                                                     \
+    }
+
+ATOMIC_CMPXCHG(_relaxed, "lr.w", "sc.w")
+ATOMIC_CMPXCHG(_acquire, "lr.w.aq", "sc.w")
+ATOMIC_CMPXCHG(_release, "lr.w", "sc.w.rl")
+ATOMIC_CMPXCHG(, "lr.w.aqrl", "sc.w.rl")
+
+#undef ATOMIC_CMPXCHG
+
+/* -------------------------------------------------------------------------- */
+/*                                  Pointers                                  */
+/* -------------------------------------------------------------------------- */
+
+/* Fully ordered pointer exchange; returns the old pointer */
+#define atomic_xchg_ptr(pp, v)                                     \
+    ((__typeof__(*(pp))) atomic_xchg((volatile uint32_t *) (pp),   \
+                                     (uint32_t) (v)))
+
+/*
+ * Fully ordered compare and swap of any word-sized object, such as a
+ * pointer or an enum; non-zero if it swapped.
+ */
+#define atomic_cas(p, old, new)                                   \
+    (atomic_cmpxchg((volatile uint32_t *) (p), (uint32_t) (old),  \
+                    (uint32_t) (new)) == (uint32_t) (old))
+
+#endif  // __ATOMIC_H__
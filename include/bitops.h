@@ -0,0 +1,51 @@
+#ifndef __BITOPS_H__
+#define __BITOPS_H__
+
+#include "types.h"
+
+/*
+ * rv32ima has no Zbb, and we link with -nostdlib, so __builtin_ctz() would
+ * pull in libgcc. Use a de Bruijn multiply instead: isolate the lowest set
+ * bit, multiply by the de Bruijn constant and use the top 5 bits as a table
+ * index. One mul, one shift, one load.
+ */
+static const uint8_t __debruijn_ffs[32] = {
+    0,  1,  28, 2,  29, 14, 24, 3,  30, 22, 20, 15, 25, 17, 4,  8,
+    31, 27, 13, 23, 21, 19, 16, 7,  26, 12, 18, 6,  11, 5,  10, 9,
+};
+
+/**
+ * @brief Index of the least significant set bit.
+ *
+ * @note Undefined for x == 0, callers must check first.
+ */
+static inline uint32_t __ffs32(uint32_t x)
+{
+    return __debruijn_ffs[((x & -x) * 0x077CB531U) >> 27];
+}
+
+/*
+ * Same trick for the top bit: smear it into every lower bit, giving
+ * 2^(n+1) - 1, which a different de Bruijn-style constant maps to n.
+ */
+static const uint8_t __debruijn_fls[32] = {
+    0, 9,  1,  10, 13, 21, 2,  29, 11, 14, 16, 18, 22, 25, 3, 30,
+    8, 12, 20, 28, 15, 17, 24, 7,  19, 27, 23, 6,  26, 5,  4, 31,
+};
+
+/**
+ * @brief Index of the most significant set bit.
+ *
+ * @note Undefined for x == 0, callers must check first.
+ */
+static inline uint32_t __fls32(uint32_t x)
+{
+    x |= x >> 1;
+    x |= x >> 2;
+    x |= x >> 4;
+    x |= x >> 8;
+    x |= x >> 16;
+    return __debruijn_fls[(x * 0x07C4ACDDU) >> 27];
+}
+
+#endif  // __BITOPS_H__
@@ -1,7 +1,35 @@
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
 #define MAX_USER_TASKS 256
 #define SYS_TASK_NUM 1
 #define SYS_STACK_SIZE 256
 #define USER_STACK_SIZE 1024
 #define PRIO_LEVEL 256
-/* interval ~= 1s */
-#define SYSTEM_TICK CLINT_TIMEBASE_FREQ
+/* timer interrupts per second */
+#define TICK_HZ 100
+/* interval ~= 10ms */
+#define SYSTEM_TICK (CLINT_TIMEBASE_FREQ / TICK_HZ)
+/* default time slice of every priority, in ticks */
+#define TIME_SLICE 5
+/* longest stretch an idle hart skips the tick for, in ticks (~1s) */
+#define TICKLESS_MAX_IDLE TICK_HZ
+/* EDF tasks admitted per hart */
+#define EDF_MAX_TASKS 16
+/* EDF utilization a hart may take on, Q16 (0x10000 = 100%) */
+#define EDF_MAX_UTIL 0x10000
+/* fair task priorities, mapped to weights like nice -20..19 */
+#define FAIR_PRIO_LEVEL 40
+/* coherence granule that shared hot fields are padded to */
+#define CACHE_LINE_SIZE 64
+/* how long the boot hart waits for secondary harts, ~10ms */
+#define SMP_BOOT_WAIT (CLINT_TIMEBASE_FREQ / 100)
+/* futex wait queues, hashed by address */
+#define FUTEX_HASH_BITS 6
+#define FUTEX_BUCKETS (1 << FUTEX_HASH_BITS)
+/* arrivals per node of a combining-tree barrier */
+#define BARRIER_FANIN 4
+/* distinct spinlock names the lock profiler keeps statistics for */
+#define LOCKSTAT_CLASSES 32
+
+#endif  // __CONFIG_H__
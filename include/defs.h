@@ -8,6 +8,13 @@
 int kprintf(const char *, ...);
 void panic(char *s);
 
+/* rbtree.c */
+void rb_insert_color(struct rb_node *, struct rb_root *);
+void rb_erase(struct rb_node *, struct rb_root *);
+struct rb_node *rb_first(struct rb_root *);
+struct rb_node *rb_last(struct rb_root *);
+struct rb_node *rb_next(struct rb_node *);
+
 /* scanf.c */
 int kscanf(const char *, ...);
 
@@ -15,23 +22,192 @@ int kscanf(const char *, ...);
 void *memset(void *, int, size_t);
 void *memcpy(void *, const void *, size_t);
 
+/* div64.c */
+uint64_t div64_u32(uint64_t, uint32_t);
+uint64_t div64_u32_rem(uint64_t, uint32_t, uint32_t *);
+
 /* kalloc.c */
 void *kalloc(size_t);
 void kfree(void *);
 
 /* task.c */
+void sched_init(void);
+void sched_init_hart(void);
 void schedule(void);
 task_t *task_init(const char *, taskFunc_t, void *, size_t, uint16_t);
+task_t *task_init_edf(const char *,
+                      taskFunc_t,
+                      void *,
+                      size_t,
+                      uint32_t,
+                      uint32_t,
+                      uint32_t);
+task_t *task_init_fair(const char *,
+                       taskFunc_t,
+                       void *,
+                       size_t,
+                       uint16_t,
+                       fair_group_t *);
 void task_startup(task_t *);
+void task_exit(void);
+uint32_t task_join(task_t *);
+uint32_t task_detach(task_t *);
 uint32_t task_resume(task_t *);
 uint32_t task_yield(void);
+uint32_t task_set_priority(task_t *, uint16_t);
+void sched_set_prio(task_t *, uint8_t);
+void task_sleep_until(uint64_t);
+void task_sleep_ticks(uint32_t);
+void task_wait_period(void);
+void task_block(spinlock_t *, uint64_t, uint32_t);
+int task_unblock(task_t *);
+void task_handoff(task_t *);
+uint64_t task_wake_expired(uint64_t);
+uint64_t task_next_wakeup(void);
+uint32_t sched_set_quantum(uint8_t, uint32_t);
+void task_tick(void);
+uint64_t task_charge(uint64_t);
+void task_preempt(uint32_t);
+
+/* sched_edf.c */
+void edf_enqueue(runqueue_t *, task_t *);
+void edf_dequeue(runqueue_t *, task_t *);
+int edf_admit(task_t *);
+void edf_retire(task_t *);
+void edf_release(task_t *, uint64_t);
+int edf_charge(task_t *, uint64_t);
+
+/* sched_fair.c */
+void fair_init(void);
+uint32_t fair_weight(uint8_t);
+int fair_enqueue(runqueue_t *, task_t *);
+int fair_dequeue(runqueue_t *, task_t *);
+task_t *fair_pick(runqueue_t *);
+task_t *fair_pick_last(runqueue_t *);
+void fair_migrate(runqueue_t *, runqueue_t *, task_t *);
+int fair_charge(runqueue_t *, task_t *, uint64_t);
+uint64_t fair_unthrottle(uint64_t, list_t *);
+uint64_t fair_next_refill(void);
+uint32_t fair_group_init(fair_group_t *, uint32_t, uint32_t);
+
+/* wait.c */
+void waitq_init(waitq_t *, const char *);
+uint64_t waitq_deadline(uint32_t);
+void waitq_add(waitq_t *, struct waiter *);
+uint32_t waitq_sleep(spinlock_t *, struct waiter *, uint64_t, uint32_t);
+uint32_t waitq_block(waitq_t *,
+                     spinlock_t *,
+                     struct waiter *,
+                     uint64_t,
+                     uint32_t);
+uint32_t waitq_wait(waitq_t *, uint64_t, uint32_t);
+struct waiter *waitq_first(waitq_t *);
+void waitq_wake(struct waiter *);
+int waitq_wake_one(waitq_t *);
+uint32_t waitq_wake_all(waitq_t *);
+
+/* sem.c */
+void sem_init(sem_t *, uint32_t, const char *);
+uint32_t sem_wait(sem_t *);
+uint32_t sem_trywait(sem_t *);
+uint32_t sem_timedwait(sem_t *, uint32_t);
+void sem_post(sem_t *);
+
+/* kmutex.c */
+void kmutex_init(kmutex_t *);
+uint32_t kmutex_lock(kmutex_t *);
+uint32_t kmutex_trylock(kmutex_t *);
+uint32_t kmutex_unlock(kmutex_t *);
+void kmutex_set_base_prio(task_t *, uint8_t);
+
+/* amutex.c */
+void amutex_init(amutex_t *, const char *);
+void amutex_lock(amutex_t *);
+uint32_t amutex_trylock(amutex_t *);
+uint32_t amutex_unlock(amutex_t *);
+
+/* event.c */
+void event_init(event_t *, const char *);
+uint32_t event_wait(event_t *, uint32_t, uint32_t, uint32_t, uint32_t *);
+uint32_t event_set(event_t *, uint32_t);
+void event_clear(event_t *, uint32_t);
+
+/* barrier.c */
+void barrier_init(barrier_t *, uint32_t, uint32_t);
+uint32_t barrier_wait(barrier_t *);
+uint32_t tbarrier_init(tbarrier_t *, uint32_t, uint32_t);
+void tbarrier_destroy(tbarrier_t *);
+uint32_t tbarrier_wait(tbarrier_t *, uint32_t);
+
+/* cond.c */
+void cond_init(cond_t *, const char *);
+void cond_wait(cond_t *, kmutex_t *);
+uint32_t cond_timedwait(cond_t *, kmutex_t *, uint32_t);
+void cond_signal(cond_t *);
+uint32_t cond_broadcast(cond_t *);
+
+/* futex.c */
+void futex_init(void);
+uint32_t kfutex_wait(volatile uint32_t *, uint32_t, uint32_t);
+uint32_t kfutex_wake(volatile uint32_t *, uint32_t);
+
+/* lockstat.c */
+#ifdef CONFIG_LOCKSTAT
+struct lock_class *lockstat_class(const char *);
+void lockstat_acquired(spinlock_t *, uint32_t, int, void *);
+void lockstat_released(spinlock_t *);
+#endif
+void lockstat_dump(uint32_t);
+void lockstat_reset(void);
+
+/* msgq.c */
+uint32_t msgq_init(msgq_t *, uint32_t, uint32_t, const char *);
+void msgq_destroy(msgq_t *);
+uint32_t msgq_send(msgq_t *, const void *, uint32_t);
+uint32_t msgq_recv(msgq_t *, void *, uint32_t);
+uint32_t msgq_send_buf(msgq_t *, void *, uint32_t);
+uint32_t msgq_recv_buf(msgq_t *, void **, uint32_t);
+void mbox_init(mbox_t *, const char *);
+uint32_t mbox_send(mbox_t *, void *, uint32_t);
+uint32_t mbox_recv(mbox_t *, void **, uint32_t);
 
 /* spinlock.c */
-void spinlock_init(spinlock_t *);
+void spinlock_init(spinlock_t *, const char *);
 int acquire(spinlock_t *);
 int release(spinlock_t *);
+void intr_push(void);
+void intr_pop(void);
+int acquire_irqsave(spinlock_t *);
+int release_irqrestore(spinlock_t *);
+void mcs_init(mcslock_t *);
+void mcs_acquire(mcslock_t *, struct mcs_node *);
+void mcs_release(mcslock_t *, struct mcs_node *);
+void seqlock_init(seqlock_t *, const char *);
+uint32_t read_seqbegin(seqlock_t *);
+int read_seqretry(seqlock_t *, uint32_t);
+void write_seqlock(seqlock_t *);
+void write_sequnlock(seqlock_t *);
+void rwlock_init(rwlock_t *);
+void read_lock(rwlock_t *);
+void read_unlock(rwlock_t *);
+void write_lock(rwlock_t *);
+void write_unlock(rwlock_t *);
 
 /* trap.c */
+void trap_init(void);
 uint32_t trap_handler(uint32_t, uint32_t);
 
+/* timer.c */
+void timer_init(void);
+uint64_t timer_now(void);
+uint64_t timer_ticks(void);
+void timer_wake_at(uint64_t);
+void timer_idle_enter(void);
+void timer_idle_exit(void);
+
+/* smp.c */
+void smp_boot(void);
+void smp_send_ipi(uint32_t);
+void smp_ipi_handler(void);
+
 #endif  // __DEFS_H__
\ No newline at end of file
@@ -34,4 +34,8 @@
 /* 10000000 ticks per-second */
 #define CLINT_TIMEBASE_FREQ 10000000
 
+/* mtime ticks in a duration */
+#define TIMER_MS(ms) ((ms) * (CLINT_TIMEBASE_FREQ / 1000))
+#define TIMER_US(us) ((us) * (CLINT_TIMEBASE_FREQ / 1000000))
+
 #endif /* __PLATFORM_H__ */
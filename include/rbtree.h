@@ -0,0 +1,54 @@
+#ifndef __RBTREE_H__
+#define __RBTREE_H__
+
+#include <stddef.h>
+#include "types.h"
+
+#ifndef container_of
+#define container_of(ptr, type, member) \
+    ((type *) ((char *) (ptr) - offsetof(type, member)))
+#endif
+
+#define RB_RED 0
+#define RB_BLACK 1
+
+#define rb_entry(ptr, type, member) container_of(ptr, type, member)
+
+/**
+ * @brief Red-black tree node, embedded in the object it orders.
+ *
+ * The tree does not know about keys: the caller walks down from the root,
+ * links the new node with rb_link_node() and rebalances with
+ * rb_insert_color(), the same split as the Linux rbtree.
+ */
+struct rb_node {
+    struct rb_node *parent;
+    struct rb_node *left;
+    struct rb_node *right;
+    uint32_t color;
+};
+
+struct rb_root {
+    struct rb_node *node;
+};
+
+static inline void rb_init(struct rb_root *root)
+{
+    root->node = NULL;
+}
+
+/**
+ * @brief Hang a new red node at *link, a NULL child slot of parent.
+ */
+static inline void rb_link_node(struct rb_node *node,
+                                struct rb_node *parent,
+                                struct rb_node **link)
+{
+    node->parent = parent;
+    node->left = NULL;
+    node->right = NULL;
+    node->color = RB_RED;
+    *link = node;
+}
+
+#endif  // __RBTREE_H__
@@ -0,0 +1,235 @@
+#ifndef __RING_H__
+#define __RING_H__
+
+#include "atomic.h"
+#include "config.h"
+#include "types.h"
+
+/*
+ * Lock-free ring buffers of 32-bit words (a pointer fits on rv32).
+ *
+ * Neither ring takes a lock or masks interrupts, so an interrupt handler
+ * can hand data to a task, or the other way round, with plain pushes and
+ * pops. Sizes are powers of two so an index wraps with a mask, and the
+ * indices written by each side sit on cache lines of their own. Rings
+ * should be static or otherwise CACHE_LINE_SIZE aligned.
+ *
+ * Ordering comes from atomic.h: a slot is written before the index that
+ * publishes it (release) and the index is read before the slot (acquire).
+ */
+
+#define __ring_aligned __attribute__((aligned(CACHE_LINE_SIZE)))
+
+static inline int ring_size_ok(uint32_t size)
+{
+    return size != 0 && (size & (size - 1)) == 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                      Single Producer, Single Consumer                      */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Wait-free ring for exactly one producer and one consumer.
+ *
+ * Each side keeps a cached copy of the other's index and only reads the
+ * shared one when the cache says full or empty.
+ */
+struct spsc_ring {
+    volatile uint32_t head __ring_aligned; /**< Next slot to fill */
+    uint32_t tail_cache;                   /**< Producer's view of tail */
+
+    volatile uint32_t tail __ring_aligned; /**< Next slot to drain */
+    uint32_t head_cache;                   /**< Consumer's view of head */
+
+    uint32_t mask __ring_aligned; /**< Slot count - 1 */
+    uint32_t *slots;              /**< mask + 1 words */
+};
+
+/* Define a static SPSC ring with its storage; size must be a power of 2 */
+#define SPSC_RING_DEFINE(name, size)                                   \
+    _Static_assert(((size) & ((size) - 1)) == 0 && (size) != 0,        \
+                   #name ": size must be a power of two");             \
+    static uint32_t name##_slots[size];                                \
+    static spsc_ring_t name = {.mask = (size) - 1, .slots = name##_slots}
+
+/**
+ * @brief Set up a ring over size words at slots.
+ *
+ * @return 0 on success, -1 if size is not a power of two.
+ */
+static inline int spsc_init(spsc_ring_t *r, uint32_t *slots, uint32_t size)
+{
+    if (!ring_size_ok(size))
+        return -1;
+
+    r->head = 0;
+    r->tail = 0;
+    r->tail_cache = 0;
+    r->head_cache = 0;
+    r->mask = size - 1;
+    r->slots = slots;
+    return 0;
+}
+
+/**
+ * @brief Append v. Producer side only.
+ *
+ * @return 0 on success, -1 if the ring is full.
+ */
+static inline int spsc_push(spsc_ring_t *r, uint32_t v)
+{
+    uint32_t head = r->head;
+
+    if (head - r->tail_cache > r->mask) {
+        r->tail_cache = atomic_load_acquire(&r->tail);
+        if (head - r->tail_cache > r->mask)
+            return -1;
+    }
+
+    r->slots[head & r->mask] = v;
+    atomic_store_release(&r->head, head + 1);
+    return 0;
+}
+
+/**
+ * @brief Take the oldest word into *v. Consumer side only.
+ *
+ * @return 0 on success, -1 if the ring is empty.
+ */
+static inline int spsc_pop(spsc_ring_t *r, uint32_t *v)
+{
+    uint32_t tail = r->tail;
+
+    if (tail == r->head_cache) {
+        r->head_cache = atomic_load_acquire(&r->head);
+        if (tail == r->head_cache)
+            return -1;
+    }
+
+    *v = r->slots[tail & r->mask];
+    atomic_store_release(&r->tail, tail + 1);
+    return 0;
+}
+
+/* Words queued; exact only on the consumer side */
+static inline uint32_t spsc_count(spsc_ring_t *r)
+{
+    return atomic_load_acquire(&r->head) - r->tail;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                       Multi Producer, Multi Consumer                       */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief One MPMC slot. seq says whose turn it is: pos when a producer at
+ * position pos may fill it, pos + 1 once filled for the consumer at pos.
+ */
+struct mpmc_cell {
+    volatile uint32_t seq;
+    uint32_t data;
+};
+
+/**
+ * @brief Bounded lock-free ring for any number of producers and consumers.
+ *
+ * Producers and consumers claim positions with a compare-and-swap on head
+ * or tail and then hand the slot over through its sequence number, so
+ * they never wait on each other's locks. A producer interrupted between
+ * claiming and filling a slot only makes consumers see the ring as empty
+ * up to that slot until it resumes.
+ */
+struct mpmc_ring {
+    volatile uint32_t head __ring_aligned; /**< Next position to fill */
+    volatile uint32_t tail __ring_aligned; /**< Next position to drain */
+    uint32_t mask __ring_aligned;          /**< Slot count - 1 */
+    struct mpmc_cell *cells;               /**< mask + 1 cells */
+};
+
+/**
+ * @brief Set up a ring over size cells.
+ *
+ * @return 0 on success, -1 if size is not a power of two.
+ */
+static inline int mpmc_init(mpmc_ring_t *r,
+                            struct mpmc_cell *cells,
+                            uint32_t size)
+{
+    if (!ring_size_ok(size))
+        return -1;
+
+    for (uint32_t i = 0; i < size; i++)
+        cells[i].seq = i;
+    r->head = 0;
+    r->tail = 0;
+    r->mask = size - 1;
+    r->cells = cells;
+    smp_wmb();
+    return 0;
+}
+
+/**
+ * @brief Append v.
+ *
+ * @return 0 on success, -1 if the ring is full.
+ */
+static inline int mpmc_push(mpmc_ring_t *r, uint32_t v)
+{
+    uint32_t pos = atomic_load_relaxed(&r->head);
+    struct mpmc_cell *cell;
+
+    while (1) {
+        cell = &r->cells[pos & r->mask];
+        int32_t diff = (int32_t) (atomic_load_acquire(&cell->seq) - pos);
+
+        if (diff == 0) {
+            uint32_t seen = atomic_cmpxchg_relaxed(&r->head, pos, pos + 1);
+            if (seen == pos)
+                break;
+            pos = seen;
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_relaxed(&r->head);
+        }
+    }
+
+    cell->data = v;
+    atomic_store_release(&cell->seq, pos + 1);
+    return 0;
+}
+
+/**
+ * @brief Take the oldest word into *v.
+ *
+ * @return 0 on success, -1 if the ring is empty.
+ */
+static inline int mpmc_pop(mpmc_ring_t *r, uint32_t *v)
+{
+    uint32_t pos = atomic_load_relaxed(&r->tail);
+    struct mpmc_cell *cell;
+
+    while (1) {
+        cell = &r->cells[pos & r->mask];
+        int32_t diff =
+            (int32_t) (atomic_load_acquire(&cell->seq) - (pos + 1));
+
+        if (diff == 0) {
+            uint32_t seen = atomic_cmpxchg_relaxed(&r->tail, pos, pos + 1);
+            if (seen == pos)
+                break;
+            pos = seen;
+        } else if (diff < 0) {
+            return -1;
+        } else {
+            pos = atomic_load_relaxed(&r->tail);
+        }
+    }
+
+    *v = cell->data;
+    atomic_store_release(&cell->seq, pos + r->mask + 1);
+    return 0;
+}
+
+#endif  // __RING_H__
@@ -7,6 +7,8 @@
 #define MSTATUS_MIE (1 << 3)
 #define MSTATUS_SIE (1 << 1)
 #define MSTATUS_UIE (1 << 0)
+#define MSTATUS_MPIE (1 << 7)
+#define MSTATUS_MPP (3 << 11)
 
 static inline uint32_t r_mstatus()
 {
@@ -25,6 +27,31 @@ static inline void w_mscratch(uint32_t x)
     asm volatile("csrw mscratch, %0" : : "r"(x));
 }
 
+static inline uint32_t r_mscratch()
+{
+    uint32_t x;
+    asm volatile("csrr %0, mscratch" : "=r"(x));
+    return x;
+}
+
+/* Disable machine interrupts, return the previous MIE bit */
+static inline uint32_t intr_save()
+{
+    uint32_t x;
+    asm volatile("csrrci %0, mstatus, %1"
+                 : "=r"(x)
+                 : "i"(MSTATUS_MIE)
+                 : "memory");
+    return x & MSTATUS_MIE;
+}
+
+/* Re-enable machine interrupts if they were on before intr_save() */
+static inline void intr_restore(uint32_t x)
+{
+    if (x)
+        asm volatile("csrsi mstatus, %0" : : "i"(MSTATUS_MIE) : "memory");
+}
+
 /* Machine-mode interrupt vector */
 static inline void w_mtvec(uint32_t x)
 {
@@ -37,6 +64,9 @@ static inline void w_mtvec(uint32_t x)
 #define MIE_MSIE (1 << 3)   // software
 
 
+/* Machine interrupt pending */
+#define MIP_MSIP (1 << 3)
+
 static inline uint32_t r_mhartid()
 {
     uint32_t x;
@@ -44,6 +74,27 @@ static inline uint32_t r_mhartid()
     return x;
 }
 
+/* Machine cycle counter, read hi/lo/hi so a carry cannot tear it */
+static inline uint64_t r_mcycle()
+{
+    uint32_t hi, lo, tmp;
+    asm volatile(
+        "1: csrr %0, mcycleh\n"
+        "   csrr %1, mcycle\n"
+        "   csrr %2, mcycleh\n"
+        "   bne %0, %2, 1b"
+        : "=&r"(hi), "=&r"(lo), "=&r"(tmp));
+    return ((uint64_t) hi << 32) | lo;
+}
+
+/* Hart id, loaded into tp by start.S */
+static inline uint32_t r_tp()
+{
+    uint32_t x;
+    asm volatile("mv %0, tp" : "=r"(x));
+    return x;
+}
+
 static inline uint32_t r_mie()
 {
     uint32_t x;
@@ -56,4 +107,31 @@ static inline void w_mie(uint32_t x)
     asm volatile("csrw mie, %0" : : "r"(x));
 }
 
+/*
+ * Spin-wait hint (Zihintpause). pause is encoded as a FENCE that cores
+ * without the extension execute as a no-op, so it is always safe.
+ */
+static inline void cpu_relax(void)
+{
+    asm volatile(".insn i 0x0F, 0, x0, x0, 0x010" ::: "memory");
+}
+
+/*
+ * Wait a little for *addr to change from old. With Zawrs (ZAWRS_ENABLE=1)
+ * the hart stalls in wrs.nto until the reservation taken by lr.w is lost
+ * to a store, instead of hammering the cache line; otherwise it pauses.
+ * Spurious returns are fine: callers re-check in a loop.
+ */
+static inline void cpu_wait_change(volatile uint32_t *addr, uint32_t old)
+{
+#ifdef CONFIG_ZAWRS
+    uint32_t x;
+    asm volatile("lr.w %0, (%1)" : "=r"(x) : "r"(addr) : "memory");
+    if (x == old)
+        asm volatile(".insn i 0x73, 0, x0, x0, 0x00d" ::: "memory");
+#else
+    cpu_relax();
+#endif
+}
+
 #endif  // __RISCV_H__
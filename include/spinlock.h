@@ -3,8 +3,90 @@
 
 typedef unsigned int uint32_t;
 
+/**
+ * @brief Ticket spinlock.
+ *
+ * acquire() draws a ticket from next and spins until owner reaches it, so
+ * harts get the lock in the order they asked for it. All-zero is an
+ * unlocked lock.
+ */
 struct spinlock {
-    volatile uint32_t locked;  // 判斷是否有被佔有(佔有:1，未佔有:0)
+    volatile uint32_t next;  /**< Next ticket to hand out */
+    volatile uint32_t owner; /**< Ticket now holding the lock */
+#ifdef CONFIG_LOCKSTAT
+    struct lock_class *cls; /**< Statistics of its name, NULL if none */
+    uint32_t hold_start;    /**< mcycle when the holder got it */
+    void *hold_pc;          /**< Where the holder called acquire() */
+#endif
 };
 
-#endif  // __SPINLOCK_H__
\ No newline at end of file
+#ifdef CONFIG_LOCKSTAT
+/**
+ * @brief Contention statistics shared by every spinlock of one name.
+ *
+ * Locks given the same name (all harts' runqueue locks, say) add up in
+ * one class, so the numbers survive locks that come and go. Objects that
+ * wait take their name from sem_init(), msgq_init() and friends. Times
+ * are in mcycle cycles of the hart that took the lock.
+ */
+struct lock_class {
+    const char *name;            /**< Name given to spinlock_init() */
+    volatile uint32_t acquired;  /**< Times taken */
+    volatile uint32_t contended; /**< Times taken only after spinning */
+    volatile uint32_t spin_lo;   /**< Total spin time, low word */
+    volatile uint32_t spin_hi;   /**< Total spin time, high word */
+    volatile uint32_t spin_max;  /**< Longest single spin */
+    volatile uint32_t hold_max;  /**< Longest single hold */
+    void *volatile hold_max_pc;  /**< Caller of acquire() for that hold */
+};
+#endif
+
+/**
+ * @brief Queue node of one MCS lock acquirer.
+ *
+ * Each waiter spins on its own node rather than on the lock, so a release
+ * only disturbs the next waiter. The node lives with the caller (usually
+ * on its stack) from mcs_acquire() to mcs_release().
+ */
+struct mcs_node {
+    struct mcs_node *volatile next; /**< Waiter queued behind us */
+    volatile uint32_t locked;       /**< Cleared when we are handed the lock */
+};
+
+/**
+ * @brief MCS queue lock: a FIFO of mcs_node, NULL when free.
+ */
+struct mcslock {
+    struct mcs_node *volatile tail; /**< Last waiter, or NULL */
+};
+
+/**
+ * @brief Sequence lock for small, read-mostly data.
+ *
+ * Writers serialize on lock and make seq odd while they update; readers
+ * take no lock, and retry if seq was odd or changed under them. A reader
+ * never holds up a writer, and never returns a torn value.
+ */
+struct seqlock {
+    volatile uint32_t seq; /**< Even when stable, odd during a write */
+    struct spinlock lock;  /**< Serializes writers */
+};
+
+/**
+ * @brief Writer-preferring reader-writer spinlock in one word.
+ *
+ * Bit 31 is set while a writer holds the lock, bits 16..30 count writers
+ * waiting for it and bits 0..15 count readers inside. New readers hold
+ * back as soon as a writer waits, so a stream of readers cannot starve
+ * writers.
+ */
+struct rwlock {
+    volatile uint32_t state; /**< RW_WRITER | waiting writers | readers */
+};
+
+#define RW_WRITER (1U << 31)
+#define RW_WAITER (1U << 16)
+#define RW_WAITERS 0x7FFF0000U
+#define RW_READERS 0x0000FFFFU
+
+#endif  // __SPINLOCK_H__
@@ -1,7 +1,12 @@
 #ifndef __TASK_H__
 #define __TASK_H__
 
+#include "config.h"
 #include "list.h"
+#include "platform.h"
+#include "rbtree.h"
+#include "riscv.h"
+#include "spinlock.h"
 #include "types.h"
 
 /* -------------------------------------------------------------------------- */
@@ -15,25 +20,48 @@ enum task_state {
     TASK_INIT = 0, /**< Task is created but not started */
     TASK_READY,    /**< Task is ready to run */
     TASK_SUSPEND,  /**< Task is suspended (waiting) */
-    TASK_RUNNING   /**< Task is currently running */
+    TASK_RUNNING,  /**< Task is currently running */
+    TASK_SLEEPING, /**< Task is on a sleep queue until wake_at */
+    TASK_BLOCKED,  /**< Task waits for a kernel event (join, ...) */
+    TASK_EXITED    /**< Task has exited, TCB and stack not reclaimed yet */
+};
+
+/**
+ * @brief Scheduling classes. A ready EDF task always runs before any
+ * priority task on the same hart, and a priority task before any fair one.
+ */
+enum sched_policy {
+    SCHED_PRIO = 0, /**< Fixed priority, round-robin within a level */
+    SCHED_EDF,      /**< Earliest deadline first with a budget per job */
+    SCHED_FAIR      /**< CPU time shared by weight, runs when nothing else */
 };
 
 /* -------------------------------------------------------------------------- */
 /*                              CPU Context Frame                             */
 /* -------------------------------------------------------------------------- */
 
+/**
+ * @brief Which registers a saved context holds (must match ctx.inc).
+ */
+enum ctx_frame {
+    CTX_FRAME_VOLUNTARY = 0, /**< switch_to(): ra, sp, s0~s11 only */
+    CTX_FRAME_FULL           /**< trap_vector: every GP register and pc */
+};
+
 /**
  * @brief CPU register context saved during context switch.
  *
- * This structure must match the order in which registers are
- * saved/restored in `switch_to` (swtch.S).
+ * This structure must match the offsets in ctx.inc used by `switch_to`
+ * (swtch.S) and `trap_vector` (trampoline.S). A voluntary switch only
+ * fills the callee-saved slots; `frame` tells the resume path which.
  *
  * ra   - return address
  * sp   - stack pointer
  * gp   - global pointer
- * tp   - thread pointer
+ * tp   - thread pointer (holds the hart id, never saved or restored)
  * t0~t6, s0~s11, a0~a7 - caller and callee saved registers
- * pc   - program counter
+ * pc   - program counter, the context is resumed with mret at this address
+ * mstatus - mstatus to install before mret (MPIE = interrupt enable)
  */
 struct context {
     uint32_t ra;
@@ -75,6 +103,81 @@ struct context {
 
     /* Saved program counter */
     uint32_t pc;
+
+    /* Saved interrupt state */
+    uint32_t mstatus;
+
+    /* enum ctx_frame, kind of frame saved above */
+    uint32_t frame;
+
+    /* Set at dispatch, cleared once the outgoing hart is done with the
+     * context; another hart must not resume it before then */
+    volatile uint32_t on_cpu;
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                 EDF Class                                  */
+/* -------------------------------------------------------------------------- */
+
+#define EDF_MISSED (1 << 0)    /**< Current job already counted as a miss */
+#define EDF_THROTTLED (1 << 1) /**< Budget exhausted, waits for next release */
+#define EDF_WAITING (1 << 2)   /**< Job done, waits for next release */
+
+/**
+ * @brief Periodic reservation of an EDF task. Times are in mtime ticks.
+ *
+ * Every period a job is released with a fresh budget and an absolute
+ * deadline of release + deadline. A job that uses up its budget is
+ * throttled until the next release.
+ */
+struct edf_entity {
+    uint32_t period;       /**< Interval between job releases */
+    uint32_t budget;       /**< Execution time allowed per job */
+    uint32_t deadline;     /**< Relative deadline of each job */
+    uint32_t util;         /**< Q16 budget / min(deadline, period) */
+    uint64_t abs_deadline; /**< Deadline of the current job, heap key */
+    uint64_t next_release; /**< Release time of the next job */
+    int32_t budget_left;   /**< Unused budget of the current job */
+    uint32_t misses;       /**< Jobs still running past their deadline */
+    uint32_t heap_idx;     /**< Position in the hart's EDF heap */
+    uint32_t flags;        /**< EDF_* */
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                 Fair Class                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief CPU bandwidth limit shared by a group of fair tasks.
+ *
+ * The tasks of a group may use quota mtime ticks of CPU per period, summed
+ * over all harts. Once the quota is used up they are held off the ready
+ * queues until the period ends.
+ */
+struct fair_group {
+    uint32_t quota;          /**< CPU time per period, mtime ticks */
+    uint32_t period;         /**< Refill interval, mtime ticks */
+    int32_t runtime_left;    /**< Quota left in this period, may overrun */
+    uint64_t period_end;     /**< mtime of the next refill */
+    uint8_t throttled;       /**< Quota used up, tasks are held */
+    list_t throttled_tasks;  /**< READY tasks held until the refill */
+    list_t list;             /**< Node on the list of all groups */
+};
+
+/**
+ * @brief Fair class state of a task.
+ *
+ * vruntime advances by the CPU time the task used, scaled by
+ * NICE_0 weight / weight, so heavier tasks advance slower and get more CPU.
+ * The ready task with the smallest vruntime runs next.
+ */
+struct fair_entity {
+    struct rb_node node;     /**< Node in the hart's vruntime tree */
+    uint64_t vruntime;       /**< Weighted CPU time, mtime ticks */
+    uint64_t sum_exec;       /**< Unweighted CPU time, mtime ticks */
+    uint32_t weight;         /**< From the priority, see fair_weight() */
+    uint8_t held;            /**< On group->throttled_tasks, not the tree */
+    struct fair_group *group; /**< Bandwidth group, or NULL for none */
 };
 
 /* -------------------------------------------------------------------------- */
@@ -103,8 +206,124 @@ struct task {
 
     ctx_t ctx; /**< Saved CPU context */
 
-    state_t state;    /**< Current task state */
-    uint8_t priority; /**< Task priority (lower value = higher priority) */
+    state_t state;         /**< Current task state, changed by CAS */
+    uint8_t priority;      /**< Task priority (lower = higher priority) */
+    uint8_t base_priority; /**< Priority without kmutex inheritance */
+    uint32_t cpu;          /**< Hart whose ready queue the task belongs to */
+
+    uint32_t time_slice; /**< Ticks left before the task can be preempted */
+
+    list_t timer_list; /**< Sleep queue linkage, sorted by wake_at */
+    uint64_t wake_at;  /**< mtime at which a sleeping task becomes READY */
+
+    struct task *joiner; /**< Joining task, JOIN_DETACHED or JOIN_EXITED */
+    struct task *wake_next; /**< Link in a hart's wakeup inbox */
+    uint8_t on_rq;          /**< Queued on cpus[cpu].rq */
+
+    list_t mutexes;            /**< kmutexes held, to undo inheritance */
+    struct kmutex *blocked_on; /**< kmutex the task waits for, or NULL */
+
+    uint8_t policy;      /**< enum sched_policy */
+    uint64_t exec_start; /**< mtime when the task was last dispatched */
+    struct edf_entity edf; /**< EDF parameters, policy == SCHED_EDF only */
+    struct fair_entity fair; /**< Fair class state, policy == SCHED_FAIR */
+};
+
+/*
+ * Values of task->joiner besides a joining task. The field moves from NULL
+ * to a joiner or JOIN_DETACHED, and then to JOIN_EXITED, each step a
+ * single atomic operation, so join, detach and exit never need a lock.
+ */
+#define JOIN_DETACHED ((struct task *) 1)
+#define JOIN_EXITED ((struct task *) 2)
+
+/* Deadline that never comes: no wakeup pending, or wait without timeout */
+#define WAKE_NEVER (~0ULL)
+
+/* -------------------------------------------------------------------------- */
+/*                                Ready Queues                                */
+/* -------------------------------------------------------------------------- */
+
+#define PRIO_GROUPS (PRIO_LEVEL / 32)
+
+/**
+ * @brief Ready queues, one FIFO per priority level.
+ *
+ * Bit b of prio_map[g] is set when queue[g * 32 + b] is non-empty, and bit g
+ * of prio_group is set when prio_map[g] is non-zero. The highest ready
+ * priority is therefore found with two find-first-set lookups, independent
+ * of how many tasks are queued.
+ */
+struct runqueue {
+    list_t queue[PRIO_LEVEL];        /**< FIFO of READY tasks per priority */
+    uint32_t prio_group;             /**< Non-empty groups of prio_map[] */
+    uint32_t prio_map[PRIO_GROUPS];  /**< Non-empty queues, 32 per group */
+    uint32_t nr_ready;               /**< Total number of queued tasks */
+
+    task_t *edf_heap[EDF_MAX_TASKS]; /**< READY EDF tasks, min-heap */
+    uint32_t nr_edf;                 /**< Number of tasks in edf_heap */
+
+    struct rb_root fair_tree;        /**< READY fair tasks by vruntime */
+    struct rb_node *fair_leftmost;   /**< Cached smallest vruntime */
+    uint64_t min_vruntime;           /**< Floor for tasks joining the tree */
+    uint32_t nr_fair;                /**< Number of tasks in fair_tree */
 };
 
+/* -------------------------------------------------------------------------- */
+/*                              Per-Hart State                                */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Scheduler state of one hart, indexed by hart id.
+ *
+ * Every hart runs its own scheduler loop on its own ready queue. The
+ * fields are protected by the hart's lock, except for the inbox, which
+ * is lock-free, and a hart's reads of its own running pointer. Other
+ * harts read load figures without the lock, as hints only.
+ */
+struct cpu {
+    spinlock_t lock;                /**< Protects rq, sleepq and running */
+    task_t *volatile inbox;         /**< Tasks handed over lock-free */
+    ctx_t ctx_sched;                /**< Context of the scheduler loop */
+    task_t *running;                /**< Task on this hart, NULL if idle */
+    runqueue_t rq;                  /**< READY tasks bound to this hart */
+    list_t sleepq;                  /**< Sleeping tasks, earliest first */
+    volatile uint32_t need_resched; /**< Switch tasks at the next trap exit */
+    volatile uint32_t online;       /**< Hart has entered schedule() */
+    uint32_t edf_util;              /**< Q16 utilization of admitted EDF */
+    uint32_t edf_tasks;             /**< Number of admitted EDF tasks */
+    uint32_t intr_depth;            /**< Nesting of intr_push() */
+    uint32_t intr_enabled;          /**< MIE before the outermost push */
+    uint32_t in_trap;               /**< Inside trap_handler() */
+};
+
+extern struct cpu cpus[MAXNUM_CPU];
+
+/**
+ * @brief Scheduler state of the calling hart.
+ *
+ * start.S loads tp with mhartid and nothing else writes it, so this is a
+ * register read rather than a CSR access.
+ */
+static inline struct cpu *mycpu(void)
+{
+    return &cpus[r_tp()];
+}
+
+/**
+ * @brief The task running on the calling hart, for use from task context.
+ *
+ * A task can be preempted and stolen by another hart between reading tp
+ * and loading ->running, so the two are done with interrupts masked.
+ * Code that already runs masked can read mycpu()->running directly.
+ */
+static inline task_t *current(void)
+{
+    uint32_t intr = intr_save();
+    task_t *t = mycpu()->running;
+
+    intr_restore(intr);
+    return t;
+}
+
 #endif  // __TASK_H__
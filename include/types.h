@@ -5,17 +5,46 @@ typedef unsigned char uint8_t;
 typedef unsigned short uint16_t;
 typedef unsigned int uint32_t;
 typedef unsigned long long uint64_t;
+typedef int int32_t;
+typedef long long int64_t;
 
 /* task.h */
 typedef struct context ctx_t;
 typedef enum task_state state_t;
 typedef struct task task_t;
+typedef struct runqueue runqueue_t;
+typedef struct fair_group fair_group_t;
 typedef void (*taskFunc_t)(void *);
 
 /* list.h */
 typedef struct list list_t;
 
+/* ring.h */
+typedef struct spsc_ring spsc_ring_t;
+typedef struct mpmc_ring mpmc_ring_t;
+
+/* rbtree.h */
+struct rb_node;
+struct rb_root;
+
 /* spinlock.h */
 typedef struct spinlock spinlock_t;
+typedef struct mcslock mcslock_t;
+typedef struct seqlock seqlock_t;
+typedef struct rwlock rwlock_t;
+struct mcs_node;
+
+/* wait.h */
+typedef struct waitq waitq_t;
+typedef struct sem sem_t;
+typedef struct kmutex kmutex_t;
+typedef struct amutex amutex_t;
+typedef struct msgq msgq_t;
+typedef struct mbox mbox_t;
+typedef struct event event_t;
+typedef struct cond cond_t;
+typedef struct barrier barrier_t;
+typedef struct tbarrier tbarrier_t;
+struct waiter;
 
 #endif  // __TYPES_H__
\ No newline at end of file
@@ -0,0 +1,203 @@
+#ifndef __WAIT_H__
+#define __WAIT_H__
+
+#include "config.h"
+#include "list.h"
+#include "spinlock.h"
+#include "types.h"
+
+/* -------------------------------------------------------------------------- */
+/*                                Wait Queues                                 */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Tasks blocked until some condition changes.
+ *
+ * Waiters are off every ready queue and use no CPU until they are woken,
+ * oldest first. The lock also protects whatever condition the user of the
+ * queue keeps next to it (a semaphore's count, for example).
+ */
+struct waitq {
+    spinlock_t lock; /**< Protects waiters and the guarded condition */
+    list_t waiters;  /**< struct waiter, oldest first */
+};
+
+/**
+ * @brief One blocked task's entry on a wait queue.
+ *
+ * Lives on the waiting task's stack for the duration of waitq_wait().
+ */
+struct waiter {
+    list_t node;            /**< Link in waitq.waiters */
+    task_t *task;           /**< The blocked task */
+    volatile uint8_t woken; /**< Set by the waker, under the queue's lock */
+    void *msg;              /**< Data handed over with the wakeup, if any */
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                Semaphores                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Counting semaphore.
+ *
+ * sem_post() hands its unit straight to the oldest waiter instead of
+ * raising count, so a woken task never has to compete for it again.
+ */
+struct sem {
+    waitq_t wq;     /**< Tasks waiting for a unit; wq.lock guards count */
+    uint32_t count; /**< Free units; no task waits while it is non-zero */
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                  Mutexes                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Sleeping mutex with priority inheritance.
+ *
+ * While a task waits, the owner runs at the waiter's priority if that is
+ * higher than its own, and so on down a chain of owners blocked on other
+ * kmutexes. All kmutex state is protected by one lock in kmutex.c.
+ */
+struct kmutex {
+    task_t *owner;  /**< Holding task, or NULL */
+    list_t waiters; /**< struct waiter, in arrival order */
+    list_t held;    /**< Link in owner->mutexes */
+};
+
+/**
+ * @brief Adaptive mutex for short critical sections on SMP.
+ *
+ * A locker spins while the owner is running on another hart, since it
+ * will probably let go soon, and sleeps on wq otherwise. owner holds the
+ * owning task_t pointer, with AMUTEX_WAITERS set while tasks sleep; the
+ * counters are bumped by each new owner, so need no atomics.
+ */
+struct amutex {
+    volatile uint32_t owner; /**< Owner task_t *, | AMUTEX_WAITERS */
+    waitq_t wq;              /**< Sleeping lockers, oldest first */
+    uint32_t fast;           /**< Taken free, at the first try */
+    uint32_t spun;           /**< Taken after spinning on a running owner */
+    uint32_t blocked;        /**< Taken after sleeping */
+};
+
+/* Low bit of amutex.owner: tasks sleep on wq (TCBs are word-aligned) */
+#define AMUTEX_WAITERS 0x1U
+
+/* -------------------------------------------------------------------------- */
+/*                        Event Flags and Condition Variables                 */
+/* -------------------------------------------------------------------------- */
+
+/* event_wait() options */
+#define EVENT_ANY 0x0   /**< Wake when any bit of the mask is set */
+#define EVENT_ALL 0x1   /**< Wake when every bit of the mask is set */
+#define EVENT_CLEAR 0x2 /**< Clear the bits that woke us */
+
+/**
+ * @brief 32 event flags that tasks wait on by mask.
+ *
+ * event_set() checks every waiter against the new flags in one pass under
+ * one lock hold and wakes all it satisfies.
+ */
+struct event {
+    waitq_t wq;     /**< Waiting tasks; wq.lock guards flags */
+    uint32_t flags; /**< Currently set flags */
+};
+
+/**
+ * @brief Condition variable for use with a kmutex.
+ */
+struct cond {
+    waitq_t wq; /**< Tasks in cond_wait(), oldest first */
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                  Barriers                                  */
+/* -------------------------------------------------------------------------- */
+
+/* How barrier waiters pass the time */
+#define BARRIER_SPIN 0  /**< Spin: one participant per hart, lowest latency */
+#define BARRIER_SLEEP 1 /**< Sleep on a futex: any number of tasks */
+
+/**
+ * @brief Centralized sense-reversing barrier.
+ *
+ * Every arrival decrements one counter; the last one resets it and flips
+ * sense, which releases everybody for the next phase. Cheap for a few
+ * participants, but they all hit the same cache line.
+ */
+struct barrier {
+    volatile uint32_t count; /**< Arrivals still missing this phase */
+    volatile uint32_t sense; /**< Phase number; waiters watch it change */
+    uint32_t parties;        /**< Participants per phase */
+    uint32_t mode;           /**< BARRIER_SPIN or BARRIER_SLEEP */
+};
+
+/**
+ * @brief One node of a combining-tree barrier, alone on its cache line.
+ */
+struct tbarrier_node {
+    /* Arrivals still missing this phase */
+    volatile uint32_t count __attribute__((aligned(CACHE_LINE_SIZE)));
+    uint32_t parties;             /**< Children, or participants at a leaf */
+    struct tbarrier_node *parent; /**< NULL at the root */
+};
+
+/**
+ * @brief Combining-tree barrier for many participants.
+ *
+ * Participants arrive at leaves of BARRIER_FANIN; the last at each node
+ * carries on to its parent, so no counter sees more than BARRIER_FANIN
+ * arrivals. The last at the root flips sense to release everyone.
+ */
+struct tbarrier {
+    volatile uint32_t sense;     /**< Phase number; waiters watch it change */
+    uint32_t parties;            /**< Participants per phase */
+    uint32_t mode;               /**< BARRIER_SPIN or BARRIER_SLEEP */
+    struct tbarrier_node *nodes; /**< Leaves first, root last */
+    void *mem;                   /**< kalloc() block holding nodes */
+};
+
+/* -------------------------------------------------------------------------- */
+/*                              Message Passing                               */
+/* -------------------------------------------------------------------------- */
+
+/* Timeout for any timed wait that waits as long as it takes */
+#define WAIT_FOREVER 0xFFFFFFFFU
+
+/**
+ * @brief Fixed-capacity FIFO of fixed-size messages.
+ *
+ * Messages are copied in and out, but a receiver that is already waiting
+ * gets a message copied straight into its buffer, and a sender that had to
+ * wait has its message copied straight into the freed slot. A queue of
+ * pointer-sized messages (msgq_send_buf() / msgq_recv_buf()) passes
+ * kalloc() buffers by reference: ownership goes with the pointer.
+ */
+struct msgq {
+    spinlock_t lock;    /**< Protects everything below */
+    waitq_t senders;    /**< Waiting for a free slot, guarded by lock */
+    waitq_t receivers;  /**< Waiting for a message, guarded by lock */
+    uint8_t *slots;     /**< capacity * msg_size bytes from kalloc() */
+    uint32_t msg_size;  /**< Bytes per message */
+    uint32_t capacity;  /**< Slots in the ring */
+    uint32_t head;      /**< Slot of the oldest message */
+    uint32_t count;     /**< Messages queued */
+};
+
+/**
+ * @brief Single-slot mailbox for request/response handoff.
+ *
+ * Carries one pointer. A send to a waiting receiver hands the message
+ * over and switches straight to the receiver if it runs on this hart.
+ */
+struct mbox {
+    spinlock_t lock;   /**< Protects everything below */
+    waitq_t senders;   /**< Waiting for the slot to empty, guarded by lock */
+    waitq_t receivers; /**< Waiting for a message, guarded by lock */
+    void *msg;         /**< The message, if full */
+    uint8_t full;      /**< Slot holds a message */
+};
+
+#endif  // __WAIT_H__
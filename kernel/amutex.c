@@ -0,0 +1,164 @@
+#include "atomic.h"
+#include "defs.h"
+#include "list.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "task.h"
+#include "types.h"
+#include "wait.h"
+
+/*
+ * Adaptive spin-then-sleep mutexes.
+ *
+ * Taking a free amutex, and releasing one nobody sleeps on, is a single
+ * compare-and-swap on the owner word. A locker that finds it held looks
+ * at the owner: while the owner is the running task of another hart, the
+ * critical section is making progress and will likely end before a sleep
+ * and wakeup would, so the locker spins. Once the owner is preempted,
+ * blocked or on our own hart, spinning would only burn the core, so the
+ * locker sets AMUTEX_WAITERS and sleeps on the wait queue. An unlock that
+ * finds the bit hands the mutex straight to the oldest sleeper.
+ *
+ * No priority inheritance: for long sections, or where priority matters,
+ * use a kmutex.
+ */
+
+#define AMUTEX_TASK(owner) ((task_t *) ((owner) & ~AMUTEX_WAITERS))
+
+void amutex_init(amutex_t *m, const char *name)
+{
+    m->owner = 0;
+    waitq_init(&m->wq, name);
+    m->fast = 0;
+    m->spun = 0;
+    m->blocked = 0;
+}
+
+/**
+ * @brief Whether to keep spinning on ptcb: it is on another hart's CPU
+ * right now and nothing wants our own CPU. A hint, read unlocked.
+ *
+ * We may have migrated since the last call, so our hart is looked up
+ * afresh with interrupts masked.
+ */
+static int amutex_should_spin(task_t *ptcb)
+{
+    struct cpu *owner = &cpus[ptcb->cpu];
+    uint32_t intr = intr_save();
+    struct cpu *c = mycpu();
+    int spin = owner != c && !c->need_resched &&
+               *(task_t *volatile *) &owner->running == ptcb;
+
+    intr_restore(intr);
+    return spin;
+}
+
+/* Wait on the sleeping side; returns 1 once m is ours, 0 to try again */
+static int amutex_sleep(amutex_t *m, task_t *curr)
+{
+    struct waiter w;
+    uint32_t intr = intr_save();
+    acquire(&m->wq.lock);
+
+    uint32_t owner = m->owner;
+    if (owner == 0 ||
+        (!(owner & AMUTEX_WAITERS) &&
+         !atomic_cas(&m->owner, owner, owner | AMUTEX_WAITERS))) {
+        release(&m->wq.lock);
+        intr_restore(intr);
+        return 0;
+    }
+
+    /* amutex_unlock() makes us the owner before it wakes us */
+    waitq_add(&m->wq, &w);
+    waitq_sleep(&m->wq.lock, &w, WAKE_NEVER, intr);
+    return 1;
+}
+
+/**
+ * @brief Take m, spinning while its owner runs elsewhere and sleeping
+ * otherwise. Tasks only; not recursive.
+ */
+void amutex_lock(amutex_t *m)
+{
+    task_t *curr = current();
+    uint32_t owner;
+    int spun = 0;
+
+    if (atomic_cas(&m->owner, 0, curr)) {
+        m->fast++;
+        return;
+    }
+
+    while (1) {
+        owner = m->owner;
+        if (owner == 0) {
+            if (atomic_cas(&m->owner, 0, curr))
+                break;
+            continue;
+        }
+
+        if (amutex_should_spin(AMUTEX_TASK(owner))) {
+            spun = 1;
+            cpu_wait_change(&m->owner, owner);
+            continue;
+        }
+
+        if (amutex_sleep(m, curr)) {
+            m->blocked++;
+            return;
+        }
+    }
+
+    if (spun)
+        m->spun++;
+    else
+        m->fast++;
+}
+
+/**
+ * @brief Take m if it is free, without spinning or blocking.
+ *
+ * @return 0 on success, -1 if m is held.
+ */
+uint32_t amutex_trylock(amutex_t *m)
+{
+    if (!atomic_cas(&m->owner, 0, current()))
+        return -1;
+    m->fast++;
+    return 0;
+}
+
+/**
+ * @brief Release m, handing it to the oldest sleeper if there is one.
+ *
+ * @return 0 on success, -1 if the running task does not hold m.
+ */
+uint32_t amutex_unlock(amutex_t *m)
+{
+    task_t *curr = current();
+    struct waiter *w;
+
+    if (AMUTEX_TASK(m->owner) != curr)
+        return -1;
+
+    /* Nobody asleep: a plain release */
+    if (atomic_cas(&m->owner, curr, 0))
+        return 0;
+
+    acquire_irqsave(&m->wq.lock);
+
+    w = waitq_first(&m->wq);
+    if (w == NULL) {
+        atomic_store_release(&m->owner, 0);
+    } else {
+        /* Keep AMUTEX_WAITERS if anyone sleeps behind the new owner */
+        uint32_t more = w->node.next != &m->wq.waiters;
+        atomic_store_release(&m->owner,
+                             (uint32_t) w->task | (more ? AMUTEX_WAITERS : 0));
+        waitq_wake(w);
+    }
+
+    release_irqrestore(&m->wq.lock);
+    return 0;
+}
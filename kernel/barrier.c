@@ -0,0 +1,169 @@
+#include <stddef.h>
+
+#include "atomic.h"
+#include "config.h"
+#include "defs.h"
+#include "riscv.h"
+#include "types.h"
+#include "wait.h"
+
+/*
+ * Reusable barriers.
+ *
+ * Both kinds release a phase by bumping a sense word that every waiter
+ * watches, so a participant can arrive for the next phase as soon as it
+ * is let go; the counters are reset by the last arrival before it flips
+ * sense, while everyone else is still held.
+ *
+ * BARRIER_SPIN waiters spin on sense and suit one participant per hart.
+ * BARRIER_SLEEP waiters sleep on it with kfutex_wait(), so participants
+ * may share harts and take no CPU while they wait.
+ */
+
+/* Wait for sense to move on from phase */
+static void barrier_hold(volatile uint32_t *sense, uint32_t phase,
+                         uint32_t mode)
+{
+    uint32_t now;
+
+    while ((now = atomic_load_acquire(sense)) == phase) {
+        if (mode == BARRIER_SLEEP)
+            kfutex_wait(sense, phase, WAIT_FOREVER);
+        else
+            cpu_wait_change(sense, now);
+    }
+}
+
+/* Start the next phase, releasing everyone held in this one */
+static void barrier_release(volatile uint32_t *sense, uint32_t phase,
+                            uint32_t parties, uint32_t mode)
+{
+    atomic_store_release(sense, phase + 1);
+    if (mode == BARRIER_SLEEP)
+        kfutex_wake(sense, parties);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                       Centralized Sense-Reversing                          */
+/* -------------------------------------------------------------------------- */
+
+void barrier_init(barrier_t *b, uint32_t parties, uint32_t mode)
+{
+    b->count = parties;
+    b->sense = 0;
+    b->parties = parties;
+    b->mode = mode;
+}
+
+/**
+ * @brief Wait until all parties have arrived at b.
+ *
+ * @return 1 to exactly one participant per phase, the last to arrive;
+ * 0 to the others.
+ */
+uint32_t barrier_wait(barrier_t *b)
+{
+    uint32_t phase = atomic_load_acquire(&b->sense);
+
+    if (atomic_fetch_sub(&b->count, 1) == 1) {
+        b->count = b->parties;
+        barrier_release(&b->sense, phase, b->parties, b->mode);
+        return 1;
+    }
+
+    barrier_hold(&b->sense, phase, b->mode);
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              Combining Tree                                */
+/* -------------------------------------------------------------------------- */
+
+/* Nodes one level up from width nodes (or participants) */
+static uint32_t tbarrier_level(uint32_t width)
+{
+    return (width + BARRIER_FANIN - 1) / BARRIER_FANIN;
+}
+
+/**
+ * @brief Set up a tree barrier for parties participants, numbered from 0.
+ *
+ * @return 0 on success, -1 if parties is 0 or the nodes cannot be
+ * allocated.
+ */
+uint32_t tbarrier_init(tbarrier_t *tb, uint32_t parties, uint32_t mode)
+{
+    uint32_t nr = 0;
+
+    if (parties == 0)
+        return -1;
+
+    for (uint32_t w = parties; w > 1 || nr == 0; w = tbarrier_level(w))
+        nr += tbarrier_level(w);
+
+    /* kalloc() aligns to 8 bytes only; round up to a cache line */
+    tb->mem = kalloc((nr + 1) * sizeof(struct tbarrier_node));
+    if (tb->mem == NULL)
+        return -1;
+    tb->nodes = (struct tbarrier_node *) (((uint32_t) tb->mem +
+                                           CACHE_LINE_SIZE - 1) &
+                                          ~(CACHE_LINE_SIZE - 1));
+
+    /* Level by level: node j of a level has children F*j .. F*j+F-1 */
+    uint32_t first = 0, width = parties;
+    do {
+        uint32_t n = tbarrier_level(width);
+        struct tbarrier_node *parent = tb->nodes + first + n;
+
+        for (uint32_t j = 0; j < n; j++) {
+            struct tbarrier_node *node = &tb->nodes[first + j];
+            uint32_t left = width - j * BARRIER_FANIN;
+
+            node->parties = left < BARRIER_FANIN ? left : BARRIER_FANIN;
+            node->count = node->parties;
+            node->parent = n > 1 ? parent + j / BARRIER_FANIN : NULL;
+        }
+        first += n;
+        width = n;
+    } while (width > 1);
+
+    tb->sense = 0;
+    tb->parties = parties;
+    tb->mode = mode;
+    return 0;
+}
+
+/* Free the nodes of a barrier nobody waits at any more */
+void tbarrier_destroy(tbarrier_t *tb)
+{
+    kfree(tb->mem);
+    tb->mem = NULL;
+    tb->nodes = NULL;
+}
+
+/**
+ * @brief Wait until all parties have arrived at tb.
+ *
+ * @param id This participant's number, below parties; each participant
+ * must use its own.
+ * @return 1 to exactly one participant per phase, the last to arrive;
+ * 0 to the others.
+ */
+uint32_t tbarrier_wait(tbarrier_t *tb, uint32_t id)
+{
+    uint32_t phase = atomic_load_acquire(&tb->sense);
+    struct tbarrier_node *node = &tb->nodes[id / BARRIER_FANIN];
+
+    /* Climb while we are the last to arrive at each node */
+    while (atomic_fetch_sub(&node->count, 1) == 1) {
+        node->count = node->parties;
+        if (node->parent == NULL) {
+            barrier_release(&tb->sense, phase, tb->parties, tb->mode);
+            return 1;
+        }
+        node = node->parent;
+    }
+
+    barrier_hold(&tb->sense, phase, tb->mode);
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "defs.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "task.h"
+#include "types.h"
+#include "wait.h"
+
+/*
+ * Condition variables for kmutex users.
+ *
+ * cond_wait() queues the caller before it gives up the kmutex, so a
+ * signal sent right after the unlock still finds it. Wakeups are hints in
+ * the usual way: re-check the condition in a loop around cond_wait().
+ */
+
+void cond_init(cond_t *cv, const char *name)
+{
+    waitq_init(&cv->wq, name);
+}
+
+static uint32_t cond_block(cond_t *cv, kmutex_t *m, uint64_t deadline)
+{
+    struct waiter w;
+    uint32_t ret;
+
+    /* Queue first: a signal after kmutex_unlock() must not be lost */
+    acquire_irqsave(&cv->wq.lock);
+    waitq_add(&cv->wq, &w);
+    release_irqrestore(&cv->wq.lock);
+
+    kmutex_unlock(m);
+
+    uint32_t intr = intr_save();
+    acquire(&cv->wq.lock);
+    ret = waitq_sleep(&cv->wq.lock, &w, deadline, intr);
+
+    kmutex_lock(m);
+    return ret;
+}
+
+/**
+ * @brief Release m, wait for a signal, and take m again.
+ *
+ * The caller must hold m.
+ */
+void cond_wait(cond_t *cv, kmutex_t *m)
+{
+    cond_block(cv, m, WAKE_NEVER);
+}
+
+/**
+ * @brief cond_wait() for at most ticks mtime ticks (WAIT_FOREVER waits
+ * for as long as it takes).
+ *
+ * m is held again on return either way.
+ *
+ * @return 0 if signalled, -1 on timeout.
+ */
+uint32_t cond_timedwait(cond_t *cv, kmutex_t *m, uint32_t ticks)
+{
+    return cond_block(cv, m, waitq_deadline(ticks));
+}
+
+/**
+ * @brief Wake the task that has waited longest, if any.
+ */
+void cond_signal(cond_t *cv)
+{
+    acquire_irqsave(&cv->wq.lock);
+    waitq_wake_one(&cv->wq);
+    release_irqrestore(&cv->wq.lock);
+}
+
+/**
+ * @brief Wake every waiting task, in one pass under one lock hold.
+ *
+ * @return How many tasks were woken.
+ */
+uint32_t cond_broadcast(cond_t *cv)
+{
+    uint32_t n;
+
+    acquire_irqsave(&cv->wq.lock);
+    n = waitq_wake_all(&cv->wq);
+    release_irqrestore(&cv->wq.lock);
+
+    return n;
+}
@@ -0,0 +1,121 @@
+#include "defs.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "task.h"
+#include "types.h"
+#include "wait.h"
+
+/*
+ * Event flags.
+ *
+ * A task waits for any or all bits of a mask; event_set() wakes every
+ * waiter the new flags satisfy, in one pass over the wait queue. What a
+ * waiter asks for and what it got travel in a struct event_req on its
+ * stack, reached through waiter.msg.
+ */
+
+struct event_req {
+    uint32_t mask; /**< Bits waited for */
+    uint32_t opts; /**< EVENT_ALL, EVENT_CLEAR */
+    uint32_t got;  /**< Flags when the wait was satisfied */
+};
+
+void event_init(event_t *ev, const char *name)
+{
+    waitq_init(&ev->wq, name);
+    ev->flags = 0;
+}
+
+/* Whether flags satisfy req; takes what it consumes. Caller holds wq.lock */
+static int event_take(event_t *ev, struct event_req *req)
+{
+    uint32_t hit = ev->flags & req->mask;
+
+    if ((req->opts & EVENT_ALL) ? hit != req->mask : hit == 0)
+        return 0;
+
+    req->got = ev->flags;
+    if (req->opts & EVENT_CLEAR)
+        ev->flags &= ~req->mask;
+    return 1;
+}
+
+/**
+ * @brief Wait until any (EVENT_ANY) or all (EVENT_ALL) bits of mask are
+ * set, for up to ticks mtime ticks (0 polls, WAIT_FOREVER blocks).
+ *
+ * With EVENT_CLEAR the bits of mask are cleared when the wait succeeds.
+ *
+ * @param got If not NULL, receives the flags that satisfied the wait.
+ * @return 0 on success, -1 on timeout or if mask is 0.
+ */
+uint32_t event_wait(event_t *ev,
+                    uint32_t mask,
+                    uint32_t opts,
+                    uint32_t ticks,
+                    uint32_t *got)
+{
+    struct event_req req = {mask, opts, 0};
+    struct waiter w;
+
+    if (mask == 0)
+        return -1;
+
+    uint32_t intr = intr_save();
+    acquire(&ev->wq.lock);
+
+    if (event_take(ev, &req)) {
+        release(&ev->wq.lock);
+        intr_restore(intr);
+    } else if (ticks == 0) {
+        release(&ev->wq.lock);
+        intr_restore(intr);
+        return -1;
+    } else {
+        /* event_set() fills in req before it wakes us */
+        w.msg = &req;
+        if (waitq_block(&ev->wq, &ev->wq.lock, &w, waitq_deadline(ticks),
+                        intr) != 0)
+            return -1;
+    }
+
+    if (got != NULL)
+        *got = req.got;
+    return 0;
+}
+
+/**
+ * @brief Set bits and wake every waiter the new flags satisfy.
+ *
+ * Waiters are checked oldest first, so an EVENT_CLEAR waiter may consume
+ * bits before younger ones see them. Safe from trap context.
+ *
+ * @return How many tasks were woken.
+ */
+uint32_t event_set(event_t *ev, uint32_t bits)
+{
+    uint32_t woken = 0;
+
+    acquire_irqsave(&ev->wq.lock);
+    ev->flags |= bits;
+
+    for (list_t *pos = ev->wq.waiters.next; pos != &ev->wq.waiters;) {
+        struct waiter *w = list_entry(pos, struct waiter, node);
+        pos = pos->next;
+
+        if (event_take(ev, w->msg)) {
+            waitq_wake(w);
+            woken++;
+        }
+    }
+
+    release_irqrestore(&ev->wq.lock);
+    return woken;
+}
+
+void event_clear(event_t *ev, uint32_t bits)
+{
+    acquire_irqsave(&ev->wq.lock);
+    ev->flags &= ~bits;
+    release_irqrestore(&ev->wq.lock);
+}
@@ -0,0 +1,99 @@
+#include "config.h"
+#include "defs.h"
+#include "list.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "task.h"
+#include "types.h"
+#include "wait.h"
+
+/*
+ * Futexes: wait on an address.
+ *
+ * A lock or barrier kept in a plain shared word needs no kernel object.
+ * Its fast path is an atomic on the word; only on contention does a task
+ * call kfutex_wait() to sleep until the word changes, and whoever changes
+ * it calls kfutex_wake(). Sleepers hang off a fixed table of wait queues
+ * hashed by address, with the address in waiter.msg, so unrelated words
+ * that share a bucket are told apart at wakeup.
+ *
+ * kfutex_wait() compares the word under the bucket lock, and a waker
+ * stores to the word before taking that lock, so a wakeup cannot slip in
+ * between the check and the sleep.
+ */
+
+static waitq_t futex_table[FUTEX_BUCKETS];
+
+void futex_init(void)
+{
+    for (int i = 0; i < FUTEX_BUCKETS; i++) {
+        spinlock_init(&futex_table[i].lock, "futex");
+        list_init(&futex_table[i].waiters);
+    }
+}
+
+/* Fibonacci hash of the word address; the low two bits are always zero */
+static waitq_t *futex_bucket(volatile uint32_t *addr)
+{
+    uint32_t h = ((uint32_t) addr >> 2) * 0x9E3779B1U;
+
+    return &futex_table[h >> (32 - FUTEX_HASH_BITS)];
+}
+
+/**
+ * @brief Sleep while *addr holds expected, for up to ticks mtime ticks
+ * (WAIT_FOREVER blocks for as long as it takes).
+ *
+ * Wakeups are not tied to any value: callers re-check the word and wait
+ * again if they still have to.
+ *
+ * @return 0 if woken by kfutex_wake(), -1 if *addr did not hold expected
+ * or the wait timed out.
+ */
+uint32_t kfutex_wait(volatile uint32_t *addr,
+                     uint32_t expected,
+                     uint32_t ticks)
+{
+    waitq_t *wq = futex_bucket(addr);
+    struct waiter w;
+
+    uint32_t intr = intr_save();
+    acquire(&wq->lock);
+
+    if (*addr != expected || ticks == 0) {
+        release(&wq->lock);
+        intr_restore(intr);
+        return -1;
+    }
+
+    w.msg = (void *) addr;
+    return waitq_block(wq, &wq->lock, &w, waitq_deadline(ticks), intr);
+}
+
+/**
+ * @brief Wake up to n tasks waiting on addr, oldest first.
+ *
+ * Change *addr first. Safe from trap context.
+ *
+ * @return How many tasks were woken.
+ */
+uint32_t kfutex_wake(volatile uint32_t *addr, uint32_t n)
+{
+    waitq_t *wq = futex_bucket(addr);
+    uint32_t woken = 0;
+
+    acquire_irqsave(&wq->lock);
+
+    for (list_t *pos = wq->waiters.next; pos != &wq->waiters && woken < n;) {
+        struct waiter *w = list_entry(pos, struct waiter, node);
+        pos = pos->next;
+
+        if (w->msg == (void *) addr) {
+            waitq_wake(w);
+            woken++;
+        }
+    }
+
+    release_irqrestore(&wq->lock);
+    return woken;
+}
@@ -1,6 +1,9 @@
 #include <stddef.h>
+#include "bitops.h"
 #include "defs.h"
 #include "list.h"
+#include "riscv.h"
+#include "spinlock.h"
 #include "types.h"
 
 // Symbols provided by the linker script
@@ -13,14 +16,7 @@ extern char stacks[];
 #define ALIGNMENT 8U
 #define MIN_PAYLOAD ALIGNMENT
 
-list_t alloc_list;
-list_t free_list;
-
-typedef struct __attribute__((aligned(ALIGNMENT))) MemHeader {
-    uint32_t start_addr;
-    size_t size;
-    list_t list;
-} MemHeader_t;
+spinlock_t kmem_lock;
 
 static inline uint32_t _align_up(uint32_t address)
 {
@@ -34,6 +30,27 @@ static inline uint32_t _align_down(uint32_t address)
     return address & (~mask);
 }
 
+#ifdef CONFIG_KALLOC_FIRSTFIT
+
+/* -------------------------------------------------------------------------- */
+/*                                 First Fit                                  */
+/* -------------------------------------------------------------------------- */
+
+/*
+ * One address-ordered free list, searched from the bottom of the heap.
+ * Allocation and free both walk the list, so their cost grows with
+ * fragmentation. Kept for comparison (KALLOC_FIRSTFIT_ENABLE=1).
+ */
+
+list_t alloc_list;
+list_t free_list;
+
+typedef struct __attribute__((aligned(ALIGNMENT))) MemHeader {
+    uint32_t start_addr;
+    size_t size;
+    list_t list;
+} MemHeader_t;
+
 static inline void memheader_init(MemHeader_t *hdr, size_t size)
 {
     hdr->start_addr = (uint32_t) (hdr + 1);
@@ -46,13 +63,12 @@ static inline uint32_t _block_end(MemHeader_t *hdr, size_t size)
     return hdr->start_addr + size;
 }
 
-void kmem_init()
+static void kmem_heap_init(uint32_t heap_start, uint32_t heap_end)
 {
     list_init(&free_list);
     list_init(&alloc_list);
 
-    uint32_t heap_end = _align_down((uint32_t) HEAP_END);
-    MemHeader_t *hdr = (MemHeader_t *) _align_up((uint32_t) HEAP_START);
+    MemHeader_t *hdr = (MemHeader_t *) heap_start;
     uint32_t payload_start = (uint32_t) (hdr + 1);
     uint32_t payload_size = heap_end - payload_start;
 
@@ -152,18 +168,238 @@ static void kmem_free(void *p)
     kmem_coalesce(hdr);
 }
 
+#else
+
+/* -------------------------------------------------------------------------- */
+/*                       Two-Level Segregated Fit (TLSF)                      */
+/* -------------------------------------------------------------------------- */
+
+/*
+ * Free blocks sit in lists by size class. The first level splits sizes
+ * by power of two, the second splits each power-of-two range into
+ * TLSF_SL_COUNT equal steps; sizes below TLSF_SMALL share first-level
+ * class 0 in ALIGNMENT steps. A bitmap per level records which lists are
+ * non-empty, so finding a block is two __ffs32() lookups, and every block
+ * links to its physical neighbours, so kfree() merges without a search.
+ * Both run in bounded time however fragmented the heap gets.
+ *
+ * A request is rounded up to the next class boundary before the lookup,
+ * so any block of the class found fits: a good fit, not a best fit.
+ */
+
+#define TLSF_SL_LOG2 4
+#define TLSF_SL_COUNT (1U << TLSF_SL_LOG2)
+#define TLSF_SMALL (TLSF_SL_COUNT * ALIGNMENT)  // first size with fl > 0
+#define TLSF_FL_SHIFT (TLSF_SL_LOG2 + 3)        // log2(TLSF_SMALL)
+#define TLSF_FL_COUNT (32 - TLSF_FL_SHIFT + 1)
+#define TLSF_MAX_REQUEST (1U << 30)
+
+#define TLSF_FREE 0x1U  // in TlsfBlock.size; sizes are multiples of 8
+
+typedef struct __attribute__((aligned(ALIGNMENT))) TlsfBlock {
+    struct TlsfBlock *prev_phys;  // block just below, NULL for the first
+    size_t size;                  // payload bytes | TLSF_FREE
+    /* Free blocks only, kept in the first bytes of the payload */
+    struct TlsfBlock *next_free;
+    struct TlsfBlock *prev_free;
+} TlsfBlock_t;
+
+#define TLSF_HDR offsetof(TlsfBlock_t, next_free)
+/* A block must hold the free links once it is freed (MIN_PAYLOAD on rv32) */
+#define TLSF_MIN_PAYLOAD (sizeof(TlsfBlock_t) - TLSF_HDR)
+
+static uint32_t tlsf_fl_map;                 // bit fl: tlsf_sl_map[fl] != 0
+static uint32_t tlsf_sl_map[TLSF_FL_COUNT];  // bit sl: list [fl][sl] in use
+static TlsfBlock_t *tlsf_free[TLSF_FL_COUNT][TLSF_SL_COUNT];
+
+static inline size_t tlsf_size(TlsfBlock_t *b)
+{
+    return b->size & ~TLSF_FREE;
+}
 
-void *kalloc(size_t size)
+static inline TlsfBlock_t *tlsf_next_phys(TlsfBlock_t *b)
+{
+    return (TlsfBlock_t *) ((uint32_t) b + TLSF_HDR + tlsf_size(b));
+}
+
+static inline void tlsf_mapping(size_t size, uint32_t *fl, uint32_t *sl)
+{
+    if (size < TLSF_SMALL) {
+        *fl = 0;
+        *sl = size / ALIGNMENT;
+    } else {
+        uint32_t top = __fls32(size);
+        *fl = top - TLSF_FL_SHIFT + 1;
+        *sl = (size >> (top - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+    }
+}
+
+static void tlsf_insert(TlsfBlock_t *b)
+{
+    uint32_t fl, sl;
+
+    tlsf_mapping(tlsf_size(b), &fl, &sl);
+    b->size |= TLSF_FREE;
+    b->prev_free = NULL;
+    b->next_free = tlsf_free[fl][sl];
+    if (b->next_free != NULL)
+        b->next_free->prev_free = b;
+    tlsf_free[fl][sl] = b;
+
+    tlsf_fl_map |= 1U << fl;
+    tlsf_sl_map[fl] |= 1U << sl;
+}
+
+static void tlsf_remove(TlsfBlock_t *b)
+{
+    uint32_t fl, sl;
+
+    tlsf_mapping(tlsf_size(b), &fl, &sl);
+    b->size &= ~TLSF_FREE;
+    if (b->next_free != NULL)
+        b->next_free->prev_free = b->prev_free;
+    if (b->prev_free != NULL) {
+        b->prev_free->next_free = b->next_free;
+        return;
+    }
+
+    tlsf_free[fl][sl] = b->next_free;
+    if (b->next_free == NULL) {
+        tlsf_sl_map[fl] &= ~(1U << sl);
+        if (tlsf_sl_map[fl] == 0)
+            tlsf_fl_map &= ~(1U << fl);
+    }
+}
+
+/* A free block of at least size bytes, or NULL */
+static TlsfBlock_t *tlsf_find(size_t size)
 {
-    if (size > 0)
-        return kmem_alloc(size);
+    uint32_t fl, sl, map;
+    TlsfBlock_t *b;
+
+    if (size < TLSF_SMALL)
+        tlsf_mapping(size, &fl, &sl);
     else
+        tlsf_mapping(size + (1U << (__fls32(size) - TLSF_SL_LOG2)) - 1, &fl,
+                     &sl);
+
+    /* The class itself or a larger one on the same level, else go up */
+    map = tlsf_sl_map[fl] & (~0U << sl);
+    if (map == 0) {
+        uint32_t fl_map = tlsf_fl_map & (~0U << (fl + 1));
+        if (fl_map != 0) {
+            fl = __ffs32(fl_map);
+            map = tlsf_sl_map[fl];
+        }
+    }
+    if (map != 0)
+        return tlsf_free[fl][__ffs32(map)];
+
+    /*
+     * Nothing in the classes that surely fit. The request's own class may
+     * still hold a big enough block, e.g. the last large one left: check
+     * its first block, which keeps this O(1).
+     */
+    tlsf_mapping(size, &fl, &sl);
+    b = tlsf_free[fl][sl];
+    return b != NULL && tlsf_size(b) >= size ? b : NULL;
+}
+
+static void kmem_heap_init(uint32_t heap_start, uint32_t heap_end)
+{
+    TlsfBlock_t *b = (TlsfBlock_t *) heap_start;
+    /* Zero-size block at the top that is never free, so no merge runs off */
+    TlsfBlock_t *sentinel = (TlsfBlock_t *) (heap_end - TLSF_HDR);
+
+    if (heap_start + TLSF_HDR + TLSF_MIN_PAYLOAD > (uint32_t) sentinel)
+        panic("Heap is too small");
+
+    b->prev_phys = NULL;
+    b->size = (uint32_t) sentinel - heap_start - TLSF_HDR;
+    sentinel->prev_phys = b;
+    sentinel->size = 0;
+    tlsf_insert(b);
+}
+
+static void *kmem_alloc(size_t size)
+{
+    if (size > TLSF_MAX_REQUEST)
         return NULL;
+
+    size_t request = _align_up(size);  // aligned payload only
+    if (request < TLSF_MIN_PAYLOAD)
+        request = TLSF_MIN_PAYLOAD;
+
+    TlsfBlock_t *b = tlsf_find(request);
+    if (b == NULL)
+        return NULL;  // no suitable block
+
+    tlsf_remove(b);
+
+    if (b->size >= request + TLSF_HDR + TLSF_MIN_PAYLOAD) {
+        // Split: [b | payload][rest | payload], rest goes back free
+        TlsfBlock_t *rest = (TlsfBlock_t *) ((uint32_t) b + TLSF_HDR + request);
+        rest->prev_phys = b;
+        rest->size = b->size - request - TLSF_HDR;
+        tlsf_next_phys(rest)->prev_phys = rest;
+        b->size = request;
+        tlsf_insert(rest);
+    }
+
+    return (void *) ((uint32_t) b + TLSF_HDR);
+}
+
+static void kmem_free(void *p)
+{
+    if (!p)
+        return;
+
+    TlsfBlock_t *b = (TlsfBlock_t *) ((uint32_t) p - TLSF_HDR);
+    TlsfBlock_t *prev = b->prev_phys;
+    TlsfBlock_t *next = tlsf_next_phys(b);
+
+    if (prev != NULL && (prev->size & TLSF_FREE)) {
+        tlsf_remove(prev);
+        prev->size += TLSF_HDR + b->size;
+        b = prev;
+    }
+
+    if (next->size & TLSF_FREE) {
+        tlsf_remove(next);
+        b->size += TLSF_HDR + next->size;
+    }
+
+    tlsf_next_phys(b)->prev_phys = b;
+    tlsf_insert(b);
+}
+
+#endif
+
+void kmem_init()
+{
+    spinlock_init(&kmem_lock, "kmem");
+    kmem_heap_init(_align_up((uint32_t) HEAP_START),
+                   _align_down((uint32_t) HEAP_END));
+}
+
+void *kalloc(size_t size)
+{
+    void *p;
+
+    if (size == 0)
+        return NULL;
+
+    acquire_irqsave(&kmem_lock);
+    p = kmem_alloc(size);
+    release_irqrestore(&kmem_lock);
+    return p;
 }
 
 void kfree(void *p)
 {
+    acquire_irqsave(&kmem_lock);
     kmem_free(p);
+    release_irqrestore(&kmem_lock);
 }
 
 void kalloc_test(void)
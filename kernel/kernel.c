@@ -3,9 +3,12 @@ extern int kprintf(const char *, ...);
 extern void uart_init(void);
 extern void kmem_init(void);
 extern void sched_init(void);
+extern void futex_init(void);
+extern void sched_init_hart(void);
 extern void trap_init(void);
 extern void timer_init(void);
 extern void vga_init(void);
+extern void smp_boot(void);
 extern void schedule(void);
 
 void empty_test(void);
@@ -17,8 +20,10 @@ void start_kernel(void)
     vga_init();
     kmem_init();
     trap_init();
-    timer_init();
     sched_init();
+    futex_init();
+    timer_init();
+    smp_boot();
     kprintf("Hello, RVOS!\n\r");
 
 #ifdef VGA_NYANCAT_TEST
@@ -33,3 +38,15 @@ void start_kernel(void)
     while (1)
         ;
 }
+
+/* Entry of the secondary harts once smp_boot() releases them (start.S) */
+void start_kernel_secondary(void)
+{
+    trap_init();
+    sched_init_hart();
+    timer_init();
+
+    schedule();
+    while (1)
+        ;
+}
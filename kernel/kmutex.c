@@ -0,0 +1,231 @@
+#include "defs.h"
+#include "list.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "task.h"
+#include "types.h"
+#include "wait.h"
+
+/*
+ * Sleeping mutexes with transitive priority inheritance.
+ *
+ * A task that finds a kmutex taken blocks on it and lends its priority to
+ * the owner. If that owner is itself blocked on another kmutex, the boost
+ * is passed on to that one's owner, and so on. On unlock the kmutex goes
+ * straight to the most urgent waiter and the old owner drops back to the
+ * highest priority it still inherits from the kmutexes it holds, or to its
+ * base_priority.
+ *
+ * Only priority tasks are boosted. An EDF waiter counts as priority 0 and
+ * a fair waiter lends nothing.
+ *
+ * Every kmutex, the owners' mutexes lists and their blocked_on links are
+ * protected by pi_lock, so a chain can be walked without a lock per hop.
+ */
+
+static spinlock_t pi_lock; /* In .bss, so unlocked before anyone runs */
+
+/* Waiter rank: EDF first, then priority tasks by priority, then fair */
+static uint32_t pi_rank(task_t *ptcb)
+{
+    if (ptcb->policy == SCHED_EDF)
+        return 0;
+    if (ptcb->policy == SCHED_PRIO)
+        return 1 + ptcb->priority;
+    return 1 + PRIO_LEVEL;
+}
+
+/* The waiter to hand m to: best rank, then longest waiting */
+static struct waiter *pi_top_waiter(kmutex_t *m)
+{
+    struct waiter *top = NULL;
+
+    for (list_t *pos = m->waiters.next; pos != &m->waiters; pos = pos->next) {
+        struct waiter *w = list_entry(pos, struct waiter, node);
+        if (top == NULL || pi_rank(w->task) < pi_rank(top->task))
+            top = w;
+    }
+    return top;
+}
+
+/* Priority a task should run at given what it holds */
+static uint8_t pi_effective(task_t *ptcb)
+{
+    uint32_t rank = 1 + ptcb->base_priority;
+
+    for (list_t *pos = ptcb->mutexes.next; pos != &ptcb->mutexes;
+         pos = pos->next) {
+        struct waiter *w = pi_top_waiter(list_entry(pos, kmutex_t, held));
+        if (w != NULL && pi_rank(w->task) < rank)
+            rank = pi_rank(w->task);
+    }
+    return rank == 0 ? 0 : rank - 1;
+}
+
+/*
+ * Bring ptcb's priority in line with its waiters, then the owner of the
+ * kmutex it is blocked on, and so on. Bounded by the number of tasks, so
+ * a deadlock cycle cannot keep us here.
+ */
+static void pi_propagate(task_t *ptcb)
+{
+    for (uint32_t hops = 0; ptcb != NULL && hops < MAX_USER_TASKS; hops++) {
+        if (ptcb->policy != SCHED_PRIO)
+            return;
+
+        uint8_t prio = pi_effective(ptcb);
+        if (prio == ptcb->priority)
+            return;
+        sched_set_prio(ptcb, prio);
+
+        if (ptcb->blocked_on == NULL)
+            return;
+        ptcb = ptcb->blocked_on->owner;
+    }
+}
+
+void kmutex_init(kmutex_t *m)
+{
+    m->owner = NULL;
+    list_init(&m->waiters);
+    list_init(&m->held);
+}
+
+/* Make curr the owner of a free kmutex; caller holds pi_lock */
+static void kmutex_take(kmutex_t *m, task_t *curr)
+{
+    m->owner = curr;
+    list_insert_before(&curr->mutexes, &m->held);
+}
+
+/**
+ * @brief Take m, blocking for as long as another task holds it.
+ *
+ * The owner inherits our priority while we wait. Tasks only; kmutexes do
+ * not nest recursively.
+ *
+ * @return 0 on success, -1 if the running task already holds m.
+ */
+uint32_t kmutex_lock(kmutex_t *m)
+{
+    uint32_t intr = intr_save();
+    task_t *curr = mycpu()->running;
+    struct waiter w;
+
+    acquire(&pi_lock);
+
+    if (m->owner == NULL) {
+        kmutex_take(m, curr);
+        release(&pi_lock);
+        intr_restore(intr);
+        return 0;
+    }
+    if (m->owner == curr) {
+        release(&pi_lock);
+        intr_restore(intr);
+        return -1;
+    }
+
+    w.task = curr;
+    w.woken = 0;
+    list_insert_before(&m->waiters, &w.node);
+    curr->blocked_on = m;
+    pi_propagate(m->owner);
+
+    /* kmutex_unlock() makes us the owner before it wakes us */
+    task_block(&pi_lock, WAKE_NEVER, intr);
+    return 0;
+}
+
+/**
+ * @brief Take m if it is free, without blocking.
+ *
+ * @return 0 on success, -1 if m is held.
+ */
+uint32_t kmutex_trylock(kmutex_t *m)
+{
+    uint32_t intr = intr_save();
+    uint32_t ret = -1;
+
+    acquire(&pi_lock);
+    if (m->owner == NULL) {
+        kmutex_take(m, mycpu()->running);
+        ret = 0;
+    }
+    release(&pi_lock);
+    intr_restore(intr);
+
+    return ret;
+}
+
+/**
+ * @brief Release m and hand it to the most urgent waiter.
+ *
+ * Any priority inherited through m is given back. If the new owner should
+ * run before us, we yield to it at once instead of at the next tick.
+ *
+ * @return 0 on success, -1 if the running task does not hold m.
+ */
+uint32_t kmutex_unlock(kmutex_t *m)
+{
+    uint32_t intr = intr_save();
+    task_t *curr = mycpu()->running;
+    task_t *next = NULL;
+    struct waiter *w;
+    int handoff = 0;
+
+    acquire(&pi_lock);
+
+    if (m->owner != curr) {
+        release(&pi_lock);
+        intr_restore(intr);
+        return -1;
+    }
+
+    list_remove(&m->held);
+    m->owner = NULL;
+
+    w = pi_top_waiter(m);
+    if (w != NULL) {
+        next = w->task;
+        list_remove(&w->node);
+        w->woken = 1;
+        next->blocked_on = NULL;
+        kmutex_take(m, next);
+
+        /* The new owner inherits from whoever still waits on m */
+        pi_propagate(next);
+    }
+
+    pi_propagate(curr);
+
+    if (next != NULL) {
+        handoff = pi_rank(next) < pi_rank(curr);
+        task_unblock(next);
+    }
+
+    release(&pi_lock);
+    intr_restore(intr);
+
+    if (handoff)
+        task_yield();
+    return 0;
+}
+
+/**
+ * @brief Set a priority task's base priority, keeping any boost it
+ * currently inherits. Called by task_set_priority().
+ */
+void kmutex_set_base_prio(task_t *ptcb, uint8_t priority)
+{
+    uint32_t intr = intr_save();
+
+    acquire(&pi_lock);
+    ptcb->base_priority = priority;
+
+    /* Lowering a boosted task's base changes nothing until it unlocks */
+    pi_propagate(ptcb);
+
+    release(&pi_lock);
+    intr_restore(intr);
+}
@@ -0,0 +1,187 @@
+#include <stddef.h>
+
+#include "atomic.h"
+#include "config.h"
+#include "defs.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "types.h"
+
+/*
+ * Spinlock contention profiler, built with LOCKSTAT_ENABLE=1.
+ *
+ * spinlock_init() files each lock under a class by name. acquire() then
+ * counts every acquisition, and for those that had to wait, the cycles
+ * spent spinning; release() measures how long the lock was held and
+ * remembers the acquire() caller of the longest hold. lockstat_dump()
+ * prints the classes that spent the most time spinning.
+ *
+ * Several locks of one class update it at once, so counters are bumped
+ * with relaxed AMOs. Statistics are approximate by design: a dump taken
+ * while locks are busy may mix values from different moments.
+ *
+ * Locks left zeroed in .bss without spinlock_init() work as before but
+ * are not profiled.
+ */
+
+#ifdef CONFIG_LOCKSTAT
+
+static struct lock_class classes[LOCKSTAT_CLASSES];
+static uint32_t nr_classes;
+static spinlock_t class_lock; /* Its cls stays NULL, so it is never profiled */
+
+static int name_eq(const char *a, const char *b)
+{
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+/**
+ * @brief Find or create the class of locks called name.
+ *
+ * @return The class, or NULL if name is NULL or the table is full; such
+ * locks go unprofiled.
+ */
+struct lock_class *lockstat_class(const char *name)
+{
+    struct lock_class *cls = NULL;
+
+    if (name == NULL)
+        return NULL;
+
+    acquire_irqsave(&class_lock);
+    for (uint32_t i = 0; i < nr_classes; i++) {
+        if (name_eq(classes[i].name, name)) {
+            cls = &classes[i];
+            break;
+        }
+    }
+    if (cls == NULL && nr_classes < LOCKSTAT_CLASSES) {
+        cls = &classes[nr_classes];
+        cls->name = name;
+        nr_classes++;
+    }
+    release_irqrestore(&class_lock);
+    return cls;
+}
+
+/**
+ * @brief Account an acquisition; called by acquire() once it holds lk.
+ *
+ * @param start mcycle before the ticket was drawn.
+ * @param contended Whether the ticket had to wait for its turn.
+ * @param pc Caller of acquire(), blamed if this hold is the longest.
+ */
+void lockstat_acquired(spinlock_t *lk, uint32_t start, int contended, void *pc)
+{
+    struct lock_class *cls = lk->cls;
+    uint32_t now = (uint32_t) r_mcycle();
+
+    lk->hold_start = now;
+    lk->hold_pc = pc;
+    if (cls == NULL)
+        return;
+
+    atomic_fetch_add_relaxed(&cls->acquired, 1);
+    if (!contended)
+        return;
+
+    uint32_t spin = now - start;
+    atomic_fetch_add_relaxed(&cls->contended, 1);
+    /* 64-bit total from two words: carry by hand when the low one wraps */
+    if (atomic_fetch_add_relaxed(&cls->spin_lo, spin) + spin < spin)
+        atomic_fetch_add_relaxed(&cls->spin_hi, 1);
+    atomic_fetch_maxu_relaxed(&cls->spin_max, spin);
+}
+
+/* Account the hold that ends now; called by release() before unlocking */
+void lockstat_released(spinlock_t *lk)
+{
+    struct lock_class *cls = lk->cls;
+
+    if (cls == NULL)
+        return;
+
+    uint32_t held = (uint32_t) r_mcycle() - lk->hold_start;
+    if (atomic_fetch_maxu_relaxed(&cls->hold_max, held) < held)
+        cls->hold_max_pc = lk->hold_pc;
+}
+
+static uint64_t class_spin(struct lock_class *cls)
+{
+    return ((uint64_t) cls->spin_hi << 32) | cls->spin_lo;
+}
+
+/**
+ * @brief Print the n classes that spent the most cycles spinning.
+ *
+ * Spin totals are in thousands of cycles; the average is per contended
+ * acquisition.
+ */
+void lockstat_dump(uint32_t n)
+{
+    struct lock_class *top[LOCKSTAT_CLASSES];
+    uint32_t nr = 0, total = nr_classes;
+
+    if (n > total)
+        n = total;
+
+    /* Insertion sort by total spin time, keeping only the first n */
+    for (uint32_t i = 0; i < total; i++) {
+        struct lock_class *cls = &classes[i];
+        uint64_t spin = class_spin(cls);
+        uint32_t j = nr < n ? nr++ : n;
+
+        while (j > 0 && class_spin(top[j - 1]) < spin) {
+            if (j < n)
+                top[j] = top[j - 1];
+            j--;
+        }
+        if (j < n)
+            top[j] = cls;
+    }
+
+    kprintf("[lockstat] top %d of %d lock classes by spin time\n", nr,
+            total);
+    for (uint32_t i = 0; i < nr; i++) {
+        struct lock_class *cls = top[i];
+        uint64_t spin = class_spin(cls);
+        uint32_t avg = cls->contended ? div64_u32(spin, cls->contended) : 0;
+
+        kprintf("[lockstat] %s: %d acquired, %d contended, spin %d kcycles "
+                "(avg %d, max %d), hold max %d at %p\n",
+                cls->name, cls->acquired, cls->contended,
+                (uint32_t) div64_u32(spin, 1000), avg, cls->spin_max,
+                cls->hold_max, cls->hold_max_pc);
+    }
+}
+
+/* Zero every class's statistics, to profile one stretch of time */
+void lockstat_reset(void)
+{
+    for (uint32_t i = 0; i < nr_classes; i++) {
+        struct lock_class *cls = &classes[i];
+
+        cls->acquired = 0;
+        cls->contended = 0;
+        cls->spin_lo = 0;
+        cls->spin_hi = 0;
+        cls->spin_max = 0;
+        cls->hold_max = 0;
+        cls->hold_max_pc = NULL;
+    }
+}
+
+#else
+
+void lockstat_dump(uint32_t n)
+{
+    kprintf("[lockstat] not built in, rebuild with LOCKSTAT_ENABLE=1\n");
+}
+
+void lockstat_reset(void) {}
+
+#endif
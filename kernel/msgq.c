@@ -0,0 +1,282 @@
+#include <string.h>
+
+#include "defs.h"
+#include "list.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "task.h"
+#include "types.h"
+#include "wait.h"
+
+/*
+ * Message queues and mailboxes.
+ *
+ * Both hand a message straight to a task that is already waiting for it,
+ * through waiter.msg, so a blocked receiver or sender wakes up with its
+ * call completed. Timeouts are in mtime ticks (see TIMER_MS / TIMER_US):
+ * 0 polls, WAIT_FOREVER blocks for as long as it takes. Sends and
+ * receives that poll never block and may be called from trap context.
+ */
+
+/* -------------------------------------------------------------------------- */
+/*                               Message Queues                               */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Set up a queue of capacity messages of msg_size bytes each.
+ *
+ * name is the queue lock's lockstat class. Both wait queues are guarded
+ * by that lock, so their own locks are never taken or profiled.
+ *
+ * @return 0 on success, -1 if a size is 0 or the ring cannot be allocated.
+ */
+uint32_t msgq_init(msgq_t *q,
+                   uint32_t msg_size,
+                   uint32_t capacity,
+                   const char *name)
+{
+    if (msg_size == 0 || capacity == 0)
+        return -1;
+
+    q->slots = kalloc(msg_size * capacity);
+    if (q->slots == NULL)
+        return -1;
+
+    spinlock_init(&q->lock, name);
+    list_init(&q->senders.waiters);
+    list_init(&q->receivers.waiters);
+    q->msg_size = msg_size;
+    q->capacity = capacity;
+    q->head = 0;
+    q->count = 0;
+    return 0;
+}
+
+/**
+ * @brief Free the ring of a queue nobody uses any more.
+ *
+ * Messages still queued are dropped; in a zero-copy queue the buffers
+ * they point to are the caller's to reclaim first.
+ */
+void msgq_destroy(msgq_t *q)
+{
+    kfree(q->slots);
+    q->slots = NULL;
+}
+
+static inline uint8_t *msgq_slot(msgq_t *q, uint32_t i)
+{
+    return q->slots + ((q->head + i) % q->capacity) * q->msg_size;
+}
+
+/**
+ * @brief Queue a copy of the msg_size bytes at msg.
+ *
+ * A waiting receiver gets the message copied into its buffer directly.
+ * If the queue is full, waits up to ticks for a slot.
+ *
+ * @return 0 on success, -1 if the queue stayed full.
+ */
+uint32_t msgq_send(msgq_t *q, const void *msg, uint32_t ticks)
+{
+    uint32_t intr = intr_save();
+    struct waiter *w, self;
+
+    acquire(&q->lock);
+
+    w = waitq_first(&q->receivers);
+    if (w != NULL) {
+        memcpy(w->msg, msg, q->msg_size);
+        waitq_wake(w);
+    } else if (q->count < q->capacity) {
+        memcpy(msgq_slot(q, q->count), msg, q->msg_size);
+        q->count++;
+    } else if (ticks != 0) {
+        /* The receiver that frees a slot copies msg into it for us */
+        self.msg = (void *) msg;
+        return waitq_block(&q->senders, &q->lock, &self,
+                           waitq_deadline(ticks), intr);
+    } else {
+        release(&q->lock);
+        intr_restore(intr);
+        return -1;
+    }
+
+    release(&q->lock);
+    intr_restore(intr);
+    return 0;
+}
+
+/**
+ * @brief Take the oldest message, copying msg_size bytes to msg.
+ *
+ * If the queue is empty, waits up to ticks for a sender.
+ *
+ * @return 0 on success, -1 if no message came.
+ */
+uint32_t msgq_recv(msgq_t *q, void *msg, uint32_t ticks)
+{
+    uint32_t intr = intr_save();
+    struct waiter *w, self;
+
+    acquire(&q->lock);
+
+    if (q->count == 0) {
+        if (ticks == 0) {
+            release(&q->lock);
+            intr_restore(intr);
+            return -1;
+        }
+        self.msg = msg;
+        return waitq_block(&q->receivers, &q->lock, &self,
+                           waitq_deadline(ticks), intr);
+    }
+
+    memcpy(msg, msgq_slot(q, 0), q->msg_size);
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+
+    /* Refill the slot from the oldest blocked sender */
+    w = waitq_first(&q->senders);
+    if (w != NULL) {
+        memcpy(msgq_slot(q, q->count), w->msg, q->msg_size);
+        q->count++;
+        waitq_wake(w);
+    }
+
+    release(&q->lock);
+    intr_restore(intr);
+    return 0;
+}
+
+/**
+ * @brief Pass a buffer to the receiver without copying it.
+ *
+ * For queues of pointer-sized messages. Ownership of buf, typically from
+ * kalloc(), goes to the receiver if this succeeds and stays with the
+ * caller if it fails.
+ *
+ * @return 0 on success, -1 if the queue stayed full or is not a pointer
+ *         queue.
+ */
+uint32_t msgq_send_buf(msgq_t *q, void *buf, uint32_t ticks)
+{
+    if (q->msg_size != sizeof(void *))
+        return -1;
+    return msgq_send(q, &buf, ticks);
+}
+
+/**
+ * @brief Receive a buffer passed with msgq_send_buf(); the caller owns it.
+ *
+ * @return 0 on success, -1 if no message came or this is not a pointer
+ *         queue.
+ */
+uint32_t msgq_recv_buf(msgq_t *q, void **buf, uint32_t ticks)
+{
+    if (q->msg_size != sizeof(void *))
+        return -1;
+    return msgq_recv(q, buf, ticks);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Mailboxes                                  */
+/* -------------------------------------------------------------------------- */
+
+/* Set up an empty mailbox; name works as for msgq_init() */
+void mbox_init(mbox_t *mb, const char *name)
+{
+    spinlock_init(&mb->lock, name);
+    list_init(&mb->senders.waiters);
+    list_init(&mb->receivers.waiters);
+    mb->msg = NULL;
+    mb->full = 0;
+}
+
+/**
+ * @brief Put msg in the mailbox, waiting up to ticks for it to empty.
+ *
+ * A receiver already waiting gets msg directly and, if it runs on this
+ * hart and is at least as urgent as the sender, the hart too: the sender
+ * switches straight to it instead of waiting for the next scheduling
+ * decision. From trap context the receiver is only woken; the switch, if
+ * due, happens on the way out of the trap.
+ *
+ * @return 0 on success, -1 if the mailbox stayed full.
+ */
+uint32_t mbox_send(mbox_t *mb, void *msg, uint32_t ticks)
+{
+    uint32_t intr = intr_save();
+    struct waiter *w, self;
+    task_t *receiver;
+
+    acquire(&mb->lock);
+
+    w = waitq_first(&mb->receivers);
+    if (w != NULL) {
+        receiver = w->task;
+        *(void **) w->msg = msg;
+        waitq_wake(w);
+        release(&mb->lock);
+        intr_restore(intr);
+
+        task_handoff(receiver);
+        return 0;
+    }
+
+    if (!mb->full) {
+        mb->msg = msg;
+        mb->full = 1;
+    } else if (ticks != 0) {
+        self.msg = msg;
+        return waitq_block(&mb->senders, &mb->lock, &self,
+                           waitq_deadline(ticks), intr);
+    } else {
+        release(&mb->lock);
+        intr_restore(intr);
+        return -1;
+    }
+
+    release(&mb->lock);
+    intr_restore(intr);
+    return 0;
+}
+
+/**
+ * @brief Take the message from the mailbox, waiting up to ticks for one.
+ *
+ * @return 0 on success, -1 if no message came.
+ */
+uint32_t mbox_recv(mbox_t *mb, void **msg, uint32_t ticks)
+{
+    uint32_t intr = intr_save();
+    struct waiter *w, self;
+
+    acquire(&mb->lock);
+
+    if (!mb->full) {
+        if (ticks == 0) {
+            release(&mb->lock);
+            intr_restore(intr);
+            return -1;
+        }
+        self.msg = msg;
+        return waitq_block(&mb->receivers, &mb->lock, &self,
+                           waitq_deadline(ticks), intr);
+    }
+
+    *msg = mb->msg;
+    mb->full = 0;
+
+    /* A blocked sender's message takes the slot at once */
+    w = waitq_first(&mb->senders);
+    if (w != NULL) {
+        mb->msg = w->msg;
+        mb->full = 1;
+        waitq_wake(w);
+    }
+
+    release(&mb->lock);
+    intr_restore(intr);
+    return 0;
+}
@@ -0,0 +1,196 @@
+#include "config.h"
+#include "defs.h"
+#include "task.h"
+#include "types.h"
+
+/*
+ * Earliest-deadline-first class.
+ *
+ * Every hart keeps its READY EDF tasks in a binary min-heap keyed on the
+ * absolute deadline of the current job; rq_peek() looks at the root before
+ * the priority bitmap. EDF tasks are bound to the hart that admitted them
+ * and are never stolen, so the per-hart utilization test stays valid.
+ *
+ * Everything here is called with the lock of the task's hart held, except
+ * edf_admit(), which takes each hart's lock in turn.
+ */
+
+extern struct cpu cpus[];
+
+/* -------------------------------------------------------------------------- */
+/*                                Deadline Heap                               */
+/* -------------------------------------------------------------------------- */
+
+static inline int edf_earlier(task_t *a, task_t *b)
+{
+    return a->edf.abs_deadline < b->edf.abs_deadline;
+}
+
+static inline void edf_heap_set(runqueue_t *rq, uint32_t i, task_t *ptcb)
+{
+    rq->edf_heap[i] = ptcb;
+    ptcb->edf.heap_idx = i;
+}
+
+static void edf_sift_up(runqueue_t *rq, uint32_t i)
+{
+    task_t *ptcb = rq->edf_heap[i];
+
+    while (i > 0) {
+        uint32_t parent = (i - 1) / 2;
+        if (!edf_earlier(ptcb, rq->edf_heap[parent]))
+            break;
+        edf_heap_set(rq, i, rq->edf_heap[parent]);
+        i = parent;
+    }
+    edf_heap_set(rq, i, ptcb);
+}
+
+static void edf_sift_down(runqueue_t *rq, uint32_t i)
+{
+    task_t *ptcb = rq->edf_heap[i];
+
+    while (1) {
+        uint32_t child = 2 * i + 1;
+        if (child >= rq->nr_edf)
+            break;
+        if (child + 1 < rq->nr_edf &&
+            edf_earlier(rq->edf_heap[child + 1], rq->edf_heap[child]))
+            child++;
+        if (!edf_earlier(rq->edf_heap[child], ptcb))
+            break;
+        edf_heap_set(rq, i, rq->edf_heap[child]);
+        i = child;
+    }
+    edf_heap_set(rq, i, ptcb);
+}
+
+/**
+ * @brief Add a READY EDF task to the deadline heap. O(log n).
+ *
+ * Admission caps the EDF tasks of a hart at EDF_MAX_TASKS, so the heap
+ * cannot overflow.
+ */
+void edf_enqueue(runqueue_t *rq, task_t *ptcb)
+{
+    uint32_t i = rq->nr_edf++;
+
+    rq->edf_heap[i] = ptcb;
+    edf_sift_up(rq, i);
+}
+
+/**
+ * @brief Remove a task from anywhere in the deadline heap. O(log n).
+ */
+void edf_dequeue(runqueue_t *rq, task_t *ptcb)
+{
+    uint32_t i = ptcb->edf.heap_idx;
+    task_t *last = rq->edf_heap[--rq->nr_edf];
+
+    if (last == ptcb)
+        return;
+
+    /* Fill the hole with the last leaf and restore the heap around it */
+    edf_heap_set(rq, i, last);
+    edf_sift_up(rq, i);
+    edf_sift_down(rq, last->edf.heap_idx);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                             Admission Control                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Reserve CPU time for a new EDF task.
+ *
+ * With deadlines no longer than periods, EDF meets every deadline on a
+ * hart as long as the sum of budget / deadline stays at or below 1. The
+ * task goes to the first online hart that can take it.
+ *
+ * @return 0 on success with ptcb->cpu set, -1 if no hart has room.
+ */
+int edf_admit(task_t *ptcb)
+{
+    /* Round up so that rounding never lets an overloaded set through */
+    uint32_t util = (uint32_t) div64_u32(
+        ((uint64_t) ptcb->edf.budget << 16) + ptcb->edf.deadline - 1,
+        ptcb->edf.deadline);
+
+    for (uint32_t i = 0; i < MAXNUM_CPU; i++) {
+        struct cpu *c = &cpus[i];
+        if (!c->online)
+            continue;
+
+        acquire(&c->lock);
+        if (c->edf_tasks >= EDF_MAX_TASKS ||
+            c->edf_util + util > EDF_MAX_UTIL) {
+            release(&c->lock);
+            continue;
+        }
+
+        c->edf_util += util;
+        c->edf_tasks++;
+        release(&c->lock);
+        ptcb->edf.util = util;
+        ptcb->cpu = i;
+        return 0;
+    }
+    return -1;
+}
+
+/**
+ * @brief Give back the utilization of an EDF task that exits.
+ */
+void edf_retire(task_t *ptcb)
+{
+    struct cpu *c = &cpus[ptcb->cpu];
+
+    c->edf_util -= ptcb->edf.util;
+    c->edf_tasks--;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                             Jobs and Budgets                               */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start a new job released at mtime release.
+ *
+ * A job that was throttled and never completed has passed its deadline
+ * by now (deadline <= period), so it is counted as a miss first.
+ */
+void edf_release(task_t *ptcb, uint64_t release)
+{
+    struct edf_entity *edf = &ptcb->edf;
+
+    if ((edf->flags & (EDF_THROTTLED | EDF_MISSED)) == EDF_THROTTLED)
+        edf->misses++;
+
+    edf->abs_deadline = release + edf->deadline;
+    edf->next_release = release + edf->period;
+    edf->budget_left = edf->budget;
+    edf->flags = 0;
+}
+
+/**
+ * @brief Charge the time since exec_start to the running EDF task.
+ *
+ * Also counts the current job as missed, once, when it is still running
+ * past its deadline.
+ *
+ * @return 1 if the job has used up its budget, 0 otherwise.
+ */
+int edf_charge(task_t *ptcb, uint64_t now)
+{
+    struct edf_entity *edf = &ptcb->edf;
+
+    edf->budget_left -= (int32_t) (now - ptcb->exec_start);
+    ptcb->exec_start = now;
+
+    if (now > edf->abs_deadline && !(edf->flags & EDF_MISSED)) {
+        edf->flags |= EDF_MISSED;
+        edf->misses++;
+    }
+
+    return edf->budget_left <= 0;
+}
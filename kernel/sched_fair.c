@@ -0,0 +1,377 @@
+#include "config.h"
+#include "defs.h"
+#include "rbtree.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "task.h"
+#include "types.h"
+
+/*
+ * Fair class.
+ *
+ * Each hart keeps its READY fair tasks in a red-black tree ordered by
+ * vruntime and runs the leftmost one. The running task is charged its
+ * measured CPU time (mtime from dispatch to switch-out), weighted by its
+ * priority, so a task that spins before yielding falls behind one that
+ * yields at once instead of getting the same number of turns.
+ *
+ * Unless noted otherwise, everything here is called with the lock of the
+ * hart that owns rq held. Bandwidth groups are shared by every hart, so
+ * their fields and held tasks are protected by fair_lock, taken inside a
+ * hart's lock.
+ */
+
+static spinlock_t fair_lock;         /* Protects groups and held tasks */
+static list_t fair_groups;           /* Every fair_group_init()ed group */
+static uint32_t fair_nr_throttled;   /* Groups currently out of quota */
+
+#define NICE_0_WEIGHT 1024
+
+/* Same curve as Linux: every priority level is worth ~10% CPU */
+static const uint32_t fair_prio_to_weight[FAIR_PRIO_LEVEL] = {
+    88761, 71755, 56483, 46273, 36291, 29154, 23254, 18705, 14949, 11916,
+    9548,  7620,  6100,  4904,  3906,  3121,  2501,  1991,  1586,  1277,
+    1024,  820,   655,   526,   423,   335,   272,   215,   172,   137,
+    110,   87,    70,    56,    45,    36,    29,    23,    18,    15,
+};
+
+void fair_init(void)
+{
+    spinlock_init(&fair_lock, "fair");
+    list_init(&fair_groups);
+    fair_nr_throttled = 0;
+}
+
+/**
+ * @brief Load weight of a fair priority; 20 is the NICE_0 weight.
+ */
+uint32_t fair_weight(uint8_t priority)
+{
+    if (priority >= FAIR_PRIO_LEVEL)
+        priority = FAIR_PRIO_LEVEL - 1;
+    return fair_prio_to_weight[priority];
+}
+
+/* delta * NICE_0_WEIGHT / weight, in 32 bits when the product fits */
+static uint64_t fair_scale(uint32_t delta, uint32_t weight)
+{
+    if (delta < (1U << 22))
+        return (delta << 10) / weight;
+    return div64_u32((uint64_t) delta << 10, weight);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                Vruntime Tree                               */
+/* -------------------------------------------------------------------------- */
+
+static inline task_t *fair_task(struct rb_node *node)
+{
+    return rb_entry(node, task_t, fair.node);
+}
+
+/* Keep min_vruntime monotonic and no larger than any runnable vruntime */
+static void fair_update_min(runqueue_t *rq, task_t *curr)
+{
+    uint64_t vmin = rq->min_vruntime;
+    int found = 0;
+
+    if (curr != NULL) {
+        vmin = curr->fair.vruntime;
+        found = 1;
+    }
+    if (rq->fair_leftmost != NULL) {
+        uint64_t left = fair_task(rq->fair_leftmost)->fair.vruntime;
+        if (!found || left < vmin)
+            vmin = left;
+        found = 1;
+    }
+
+    if (found && vmin > rq->min_vruntime)
+        rq->min_vruntime = vmin;
+}
+
+static void fair_tree_insert(runqueue_t *rq, task_t *ptcb)
+{
+    struct rb_node **link = &rq->fair_tree.node;
+    struct rb_node *parent = NULL;
+    int leftmost = 1;
+
+    /* Equal keys go right, so a requeued task lands behind its peers */
+    while (*link != NULL) {
+        parent = *link;
+        if (ptcb->fair.vruntime < fair_task(parent)->fair.vruntime) {
+            link = &parent->left;
+        } else {
+            link = &parent->right;
+            leftmost = 0;
+        }
+    }
+
+    rb_link_node(&ptcb->fair.node, parent, link);
+    rb_insert_color(&ptcb->fair.node, &rq->fair_tree);
+    if (leftmost)
+        rq->fair_leftmost = &ptcb->fair.node;
+    rq->nr_fair++;
+}
+
+static void fair_tree_remove(runqueue_t *rq, task_t *ptcb)
+{
+    if (rq->fair_leftmost == &ptcb->fair.node)
+        rq->fair_leftmost = rb_next(&ptcb->fair.node);
+    rb_erase(&ptcb->fair.node, &rq->fair_tree);
+    rq->nr_fair--;
+}
+
+/*
+ * Park a READY task of a throttled group until its quota is refilled.
+ * Caller holds fair_lock.
+ */
+static void fair_hold(task_t *ptcb)
+{
+    list_insert_before(&ptcb->fair.group->throttled_tasks, &ptcb->list);
+    ptcb->fair.held = 1;
+}
+
+/**
+ * @brief Queue a READY fair task on rq.
+ *
+ * A task is placed no further back than min_vruntime, so time spent
+ * sleeping does not turn into a burst of CPU when it wakes. A task whose
+ * group is throttled is held on the group instead.
+ *
+ * @return 1 if the task went into the tree, 0 if it was held.
+ */
+int fair_enqueue(runqueue_t *rq, task_t *ptcb)
+{
+    if (ptcb->fair.group != NULL) {
+        acquire(&fair_lock);
+        if (ptcb->fair.group->throttled) {
+            fair_hold(ptcb);
+            release(&fair_lock);
+            return 0;
+        }
+        release(&fair_lock);
+    }
+
+    if (ptcb->fair.vruntime < rq->min_vruntime)
+        ptcb->fair.vruntime = rq->min_vruntime;
+    fair_tree_insert(rq, ptcb);
+    return 1;
+}
+
+/**
+ * @brief Take a READY fair task off rq, or off its group if held.
+ *
+ * @return 1 if the task was in the tree, 0 if it was held.
+ */
+int fair_dequeue(runqueue_t *rq, task_t *ptcb)
+{
+    if (ptcb->fair.held) {
+        acquire(&fair_lock);
+        list_remove(&ptcb->list);
+        ptcb->fair.held = 0;
+        release(&fair_lock);
+        return 0;
+    }
+
+    fair_tree_remove(rq, ptcb);
+    return 1;
+}
+
+/**
+ * @brief The fair task with the smallest vruntime, still queued.
+ *
+ * Tasks whose group ran out of quota since they were queued are moved to
+ * their group on the way, and rq->nr_ready is adjusted for them.
+ */
+task_t *fair_pick(runqueue_t *rq)
+{
+    while (rq->fair_leftmost != NULL) {
+        task_t *ptcb = fair_task(rq->fair_leftmost);
+
+        if (ptcb->fair.group == NULL || !ptcb->fair.group->throttled)
+            return ptcb;
+
+        /* Unlocked peek above; the group may have been refilled since */
+        acquire(&fair_lock);
+        if (!ptcb->fair.group->throttled) {
+            release(&fair_lock);
+            return ptcb;
+        }
+        fair_tree_remove(rq, ptcb);
+        fair_hold(ptcb);
+        release(&fair_lock);
+        rq->nr_ready--;
+    }
+    return NULL;
+}
+
+/**
+ * @brief The fair task with the largest vruntime, the one to steal.
+ */
+task_t *fair_pick_last(runqueue_t *rq)
+{
+    struct rb_node *node = rb_last(&rq->fair_tree);
+
+    return node != NULL ? fair_task(node) : NULL;
+}
+
+/**
+ * @brief Carry a task's lag over to another hart's vruntime scale.
+ *
+ * Call between dequeueing from one runqueue and enqueueing on the other.
+ */
+void fair_migrate(runqueue_t *from, runqueue_t *to, task_t *ptcb)
+{
+    ptcb->fair.vruntime =
+        ptcb->fair.vruntime - from->min_vruntime + to->min_vruntime;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                             Runtime Accounting                             */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Start a new period if the current one is over.
+ *
+ * An overrun of the last period is paid back from the new quota. Caller
+ * holds fair_lock.
+ *
+ * @return 1 if the group was throttled and may run again.
+ */
+static int fair_group_refill(fair_group_t *group, uint64_t now)
+{
+    if (now < group->period_end)
+        return 0;
+
+    if (group->runtime_left > 0)
+        group->runtime_left = 0;
+    group->runtime_left += group->quota;
+
+    group->period_end += group->period;
+    if (group->period_end <= now)
+        group->period_end = now + group->period;
+
+    if (group->throttled && group->runtime_left > 0) {
+        group->throttled = 0;
+        fair_nr_throttled--;
+        return 1;
+    }
+    return 0;
+}
+
+/**
+ * @brief Charge the time since exec_start to the running fair task.
+ *
+ * @return 1 if the task's group is now out of quota.
+ */
+int fair_charge(runqueue_t *rq, task_t *ptcb, uint64_t now)
+{
+    fair_group_t *group = ptcb->fair.group;
+    uint32_t delta = (uint32_t) (now - ptcb->exec_start);
+
+    ptcb->exec_start = now;
+    ptcb->fair.sum_exec += delta;
+    ptcb->fair.vruntime += fair_scale(delta, ptcb->fair.weight);
+    fair_update_min(rq, ptcb);
+
+    if (group == NULL)
+        return 0;
+
+    acquire(&fair_lock);
+    fair_group_refill(group, now);
+    group->runtime_left -= (int32_t) delta;
+    if (group->runtime_left <= 0 && !group->throttled) {
+        group->throttled = 1;
+        fair_nr_throttled++;
+    }
+    int throttled = group->throttled;
+    release(&fair_lock);
+
+    return throttled;
+}
+
+/**
+ * @brief Refill groups whose period is over and hand back the tasks they
+ * held.
+ *
+ * The held tasks, still READY, are moved to out, which is initialized
+ * here. They may belong to any hart; the caller queues each on its own.
+ *
+ * @return When the earliest group still throttled is refilled, or ~0.
+ */
+uint64_t fair_unthrottle(uint64_t now, list_t *out)
+{
+    list_init(out);
+    if (fair_nr_throttled == 0)
+        return ~0ULL;
+
+    acquire(&fair_lock);
+    for (list_t *pos = fair_groups.next; pos != &fair_groups; pos = pos->next) {
+        fair_group_t *group = list_entry(pos, fair_group_t, list);
+
+        if (!group->throttled || !fair_group_refill(group, now))
+            continue;
+
+        while (!list_empty(&group->throttled_tasks)) {
+            task_t *ptcb =
+                list_entry(group->throttled_tasks.next, task_t, list);
+            list_remove(&ptcb->list);
+            ptcb->fair.held = 0;
+            list_insert_before(out, &ptcb->list);
+        }
+    }
+    release(&fair_lock);
+
+    return fair_next_refill();
+}
+
+/**
+ * @brief When the earliest throttled group gets its quota back.
+ *
+ * @return An mtime, or ~0 if no group is throttled.
+ */
+uint64_t fair_next_refill(void)
+{
+    uint64_t next = ~0ULL;
+
+    if (fair_nr_throttled == 0)
+        return next;
+
+    acquire(&fair_lock);
+    for (list_t *pos = fair_groups.next; pos != &fair_groups; pos = pos->next) {
+        fair_group_t *group = list_entry(pos, fair_group_t, list);
+        if (group->throttled && group->period_end < next)
+            next = group->period_end;
+    }
+    release(&fair_lock);
+    return next;
+}
+
+/**
+ * @brief Set up a bandwidth group and start its first period.
+ *
+ * Tasks join the group through task_init_fair(). Takes fair_lock itself.
+ *
+ * @return 0 on success, -1 if quota or period is 0, or quota is more than
+ *         every hart could use in one period.
+ */
+uint32_t fair_group_init(fair_group_t *group, uint32_t quota, uint32_t period)
+{
+    if (quota == 0 || period == 0 || quota > 0x7FFFFFFF ||
+        quota / MAXNUM_CPU > period)
+        return -1;
+
+    group->quota = quota;
+    group->period = period;
+    group->runtime_left = quota;
+    group->period_end = timer_now() + period;
+    group->throttled = 0;
+    list_init(&group->throttled_tasks);
+
+    acquire_irqsave(&fair_lock);
+    list_insert_before(&fair_groups, &group->list);
+    release_irqrestore(&fair_lock);
+
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include "defs.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "task.h"
+#include "types.h"
+#include "wait.h"
+
+/*
+ * Counting semaphores on top of wait queues.
+ *
+ * A task that finds no free unit blocks on the semaphore's wait queue and
+ * uses no CPU until sem_post() hands it one. sem_post() never blocks and
+ * may be called from trap context; the waiting calls are for tasks only.
+ */
+
+void sem_init(sem_t *sem, uint32_t count, const char *name)
+{
+    waitq_init(&sem->wq, name);
+    sem->count = count;
+}
+
+/* Take a unit, waiting until deadline at most */
+static uint32_t sem_down(sem_t *sem, uint64_t deadline)
+{
+    uint32_t intr = intr_save();
+    acquire(&sem->wq.lock);
+
+    if (sem->count > 0) {
+        sem->count--;
+        release(&sem->wq.lock);
+        intr_restore(intr);
+        return 0;
+    }
+
+    if (deadline <= timer_now()) {
+        release(&sem->wq.lock);
+        intr_restore(intr);
+        return -1;
+    }
+
+    return waitq_wait(&sem->wq, deadline, intr);
+}
+
+/**
+ * @brief Take a unit, blocking for as long as none is free.
+ *
+ * @return 0
+ */
+uint32_t sem_wait(sem_t *sem)
+{
+    return sem_down(sem, WAKE_NEVER);
+}
+
+/**
+ * @brief Take a unit if one is free, without blocking.
+ *
+ * @return 0 on success, -1 if the count is zero.
+ */
+uint32_t sem_trywait(sem_t *sem)
+{
+    return sem_down(sem, 0);
+}
+
+/**
+ * @brief Take a unit, blocking for at most ticks mtime ticks (see
+ * TIMER_MS / TIMER_US; WAIT_FOREVER blocks for as long as it takes).
+ *
+ * @return 0 on success, -1 on timeout.
+ */
+uint32_t sem_timedwait(sem_t *sem, uint32_t ticks)
+{
+    return sem_down(sem, waitq_deadline(ticks));
+}
+
+/**
+ * @brief Release a unit, handing it to the oldest waiter if there is one.
+ */
+void sem_post(sem_t *sem)
+{
+    acquire_irqsave(&sem->wq.lock);
+
+    if (!waitq_wake_one(&sem->wq))
+        sem->count++;
+
+    release_irqrestore(&sem->wq.lock);
+}
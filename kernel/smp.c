@@ -0,0 +1,60 @@
+#include "config.h"
+#include "defs.h"
+#include "platform.h"
+#include "riscv.h"
+#include "task.h"
+#include "types.h"
+
+/*
+ * Inter-hart signalling through the CLINT software interrupt (MSIP).
+ *
+ * An IPI is only a doorbell: the sender has already pushed a task on the
+ * receiver's wakeup inbox, or updated its run queue under the receiver's
+ * lock, and the receiver just has to look at it.
+ */
+
+void smp_send_ipi(uint32_t hartid)
+{
+    *(volatile uint32_t *) CLINT_MSIP(hartid) = 1;
+}
+
+static void smp_clear_ipi(void)
+{
+    *(volatile uint32_t *) CLINT_MSIP(r_mhartid()) = 0;
+}
+
+/**
+ * @brief Software interrupt handler.
+ *
+ * Another hart queued work for us. If we are idle the interrupt has already
+ * woken the scheduler loop out of wfi; if a task is running, task_preempt()
+ * drains the inbox on the way out of the trap and decides whether to
+ * switch.
+ */
+void smp_ipi_handler(void)
+{
+    smp_clear_ipi();
+}
+
+/**
+ * @brief Release the parked secondary harts (boot hart only).
+ *
+ * QEMU does not tell us how many harts exist, so raise MSIP on every
+ * possible hart and give them SMP_BOOT_WAIT to check in through
+ * sched_init_hart(). Harts that do not exist ignore the write.
+ */
+void smp_boot(void)
+{
+    uint32_t online = 0;
+
+    for (uint32_t i = 1; i < MAXNUM_CPU; i++)
+        smp_send_ipi(i);
+
+    uint64_t deadline = timer_now() + SMP_BOOT_WAIT;
+    while (timer_now() < deadline)
+        ;
+
+    for (uint32_t i = 0; i < MAXNUM_CPU; i++)
+        online += cpus[i].online;
+    kprintf("SMP: %d hart(s) online\n", online);
+}
@@ -1,20 +1,251 @@
-#include "spinlock.h"
+#include "atomic.h"
+#include "defs.h"
 #include "riscv.h"
+#include "spinlock.h"
+#include "task.h"
+
+/* -------------------------------------------------------------------------- */
+/*                              Ticket Spinlock                               */
+/* -------------------------------------------------------------------------- */
 
-void spinlock_init(spinlock_t *lk)
+/**
+ * @brief Set up an unlocked lock.
+ *
+ * name identifies the lock in lockstat_dump() when the kernel is built
+ * with LOCKSTAT_ENABLE=1; it must outlive the lock, a literal is best.
+ */
+void spinlock_init(spinlock_t *lk, const char *name)
 {
-    lk->locked = 0;
+    lk->next = 0;
+    lk->owner = 0;
+#ifdef CONFIG_LOCKSTAT
+    lk->cls = lockstat_class(name);
+    lk->hold_pc = NULL;
+#endif
 }
 
-int acquire(spinlock_t *lk)
+/* pc is the caller to blame for the hold, when profiling */
+static inline int __acquire(spinlock_t *lk, void *pc)
 {
-    while (__sync_lock_test_and_set(&lk->locked, 1) != 0)
-        ;
+#ifdef CONFIG_LOCKSTAT
+    uint32_t start = (uint32_t) r_mcycle();
+#endif
+    uint32_t ticket = atomic_fetch_add_relaxed(&lk->next, 1);
+    uint32_t owner;
+    int contended = 0;
+
+    while ((owner = lk->owner) != ticket) {
+        contended = 1;
+        cpu_wait_change(&lk->owner, owner);
+    }
+    smp_acquire();
+#ifdef CONFIG_LOCKSTAT
+    lockstat_acquired(lk, start, contended, pc);
+#else
+    (void) contended;
+    (void) pc;
+#endif
     return 0;
 }
 
+int acquire(spinlock_t *lk)
+{
+    return __acquire(lk, __builtin_return_address(0));
+}
+
 int release(spinlock_t *lk)
 {
-    __sync_lock_release(&lk->locked);
+#ifdef CONFIG_LOCKSTAT
+    lockstat_released(lk);
+#endif
+    /* Only the holder writes owner, so a plain increment is enough */
+    atomic_store_release(&lk->owner, lk->owner + 1);
     return 0;
 }
+
+/* -------------------------------------------------------------------------- */
+/*                         Interrupt-Safe Variants                            */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Mask interrupts, counting nested calls on this hart.
+ *
+ * Only the outermost call remembers whether interrupts were on, and only
+ * the matching intr_pop() turns them back on.
+ */
+void intr_push(void)
+{
+    uint32_t intr = intr_save();
+    struct cpu *c = mycpu();
+
+    if (c->intr_depth == 0)
+        c->intr_enabled = intr;
+    c->intr_depth++;
+}
+
+void intr_pop(void)
+{
+    struct cpu *c = mycpu();
+
+    if (c->intr_depth == 0)
+        panic("intr_pop: not pushed");
+    if (--c->intr_depth == 0)
+        intr_restore(c->intr_enabled);
+}
+
+/**
+ * @brief Take a lock that an interrupt handler may also take.
+ *
+ * Interrupts stay masked until the matching release_irqrestore(), so the
+ * handler cannot spin on a lock held by the code it interrupted. Nests.
+ */
+int acquire_irqsave(spinlock_t *lk)
+{
+    intr_push();
+    return __acquire(lk, __builtin_return_address(0));
+}
+
+int release_irqrestore(spinlock_t *lk)
+{
+    release(lk);
+    intr_pop();
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              MCS Queue Lock                                */
+/* -------------------------------------------------------------------------- */
+
+void mcs_init(mcslock_t *lk)
+{
+    lk->tail = NULL;
+}
+
+void mcs_acquire(mcslock_t *lk, struct mcs_node *node)
+{
+    struct mcs_node *prev;
+
+    node->next = NULL;
+    node->locked = 1;
+
+    prev = atomic_xchg_ptr(&lk->tail, node);
+    if (prev != NULL) {
+        prev->next = node;
+        while (node->locked)
+            cpu_wait_change(&node->locked, 1);
+        smp_acquire();
+    }
+}
+
+void mcs_release(mcslock_t *lk, struct mcs_node *node)
+{
+    if (node->next == NULL) {
+        /* Nobody queued: free the lock, unless someone is just arriving */
+        if (atomic_cas(&lk->tail, node, NULL))
+            return;
+        while (node->next == NULL)
+            cpu_relax();
+    }
+    atomic_store_release(&node->next->locked, 0);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Seqlock                                   */
+/* -------------------------------------------------------------------------- */
+
+void seqlock_init(seqlock_t *sl, const char *name)
+{
+    sl->seq = 0;
+    spinlock_init(&sl->lock, name);
+}
+
+/**
+ * @brief Start a lockless read; pass the result to read_seqretry().
+ *
+ * Waits out a write in progress, so the snapshot starts stable.
+ */
+uint32_t read_seqbegin(seqlock_t *sl)
+{
+    uint32_t seq;
+
+    while ((seq = sl->seq) & 1)
+        cpu_wait_change(&sl->seq, seq);
+    smp_rmb();
+    return seq;
+}
+
+/**
+ * @brief Whether a read that began at seq raced with a writer.
+ *
+ * @return Non-zero if the data read must be thrown away and read again.
+ */
+int read_seqretry(seqlock_t *sl, uint32_t seq)
+{
+    smp_rmb();
+    return sl->seq != seq;
+}
+
+void write_seqlock(seqlock_t *sl)
+{
+    acquire(&sl->lock);
+    sl->seq = sl->seq + 1;
+    smp_wmb();
+}
+
+void write_sequnlock(seqlock_t *sl)
+{
+    smp_wmb();
+    sl->seq = sl->seq + 1;
+    release(&sl->lock);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              Reader-Writer Lock                            */
+/* -------------------------------------------------------------------------- */
+
+void rwlock_init(rwlock_t *rw)
+{
+    rw->state = 0;
+}
+
+void read_lock(rwlock_t *rw)
+{
+    while (1) {
+        uint32_t state = rw->state;
+
+        /* Writers first: stay out while one holds or waits for the lock */
+        if (state & (RW_WRITER | RW_WAITERS)) {
+            cpu_wait_change(&rw->state, state);
+            continue;
+        }
+        if (atomic_cmpxchg_acquire(&rw->state, state, state + 1) == state)
+            return;
+    }
+}
+
+void read_unlock(rwlock_t *rw)
+{
+    atomic_fetch_sub_release(&rw->state, 1);
+}
+
+void write_lock(rwlock_t *rw)
+{
+    atomic_fetch_add_relaxed(&rw->state, RW_WAITER);
+
+    while (1) {
+        uint32_t state = rw->state;
+
+        if (state & (RW_WRITER | RW_READERS)) {
+            cpu_wait_change(&rw->state, state);
+            continue;
+        }
+        if (atomic_cmpxchg_acquire(&rw->state, state,
+                                   (state - RW_WAITER) | RW_WRITER) == state)
+            return;
+    }
+}
+
+void write_unlock(rwlock_t *rw)
+{
+    atomic_fetch_and_release(&rw->state, ~RW_WRITER);
+}
@@ -1,6 +1,8 @@
 #include <stddef.h>
 #include <string.h>
 
+#include "atomic.h"
+#include "bitops.h"
 #include "defs.h"
 #include "list.h"
 #include "riscv.h"
@@ -16,112 +18,961 @@ extern void switch_to(ctx_t *prev, ctx_t *next);
 /* -------------------------------------------------------------------------- */
 /*                                 Globals                                    */
 /* -------------------------------------------------------------------------- */
-task_t task_list[256];       /* Static task pool */
-task_t *task_running = NULL; /* Currently running task */
-task_t task_ready;           /* Ready queue head (sentinel node) */
-uint32_t task_idx;           /* Next TCB index for allocation */
-spinlock_t task_lock;
-ctx_t ctx_sched;
+task_t task_list[MAX_USER_TASKS]; /* Static task pool */
+struct cpu cpus[MAXNUM_CPU];      /* Per-hart scheduler state */
+list_t task_pool;                 /* Free TCBs */
+list_t task_dead;                 /* Exited detached tasks to reclaim */
+spinlock_t pool_lock;             /* Protects task_pool and task_dead */
+
+uint32_t sched_quantum[PRIO_LEVEL]; /* Time slice per priority, in ticks */
+
+static void task_reap(void);
+
+/*
+ * Locking
+ *
+ * Each hart's ready queue, sleep queue and running task are protected by
+ * that hart's cpus[].lock, taken with interrupts masked. Code holds at most
+ * one hart lock, except that a thief takes its own and its victim's in
+ * hart order. Tasks are handed to another hart, or to our own from an
+ * interrupt, through its lock-free inbox instead, which only the owning
+ * hart drains. Task state changes that can race (wakeups, resume, join,
+ * detach, exit) are compare-and-swap on the TCB.
+ *
+ * Lock order: a wait queue's lock or the kmutex pi_lock, then cpus[].lock,
+ * then pool_lock or the fair class's fair_lock.
+ */
+
+/* -------------------------------------------------------------------------- */
+/*                                Ready Queues                                */
+/* -------------------------------------------------------------------------- */
+
+static void rq_init(runqueue_t *rq)
+{
+    for (int i = 0; i < PRIO_LEVEL; i++)
+        list_init(&rq->queue[i]);
+    for (int i = 0; i < PRIO_GROUPS; i++)
+        rq->prio_map[i] = 0;
+    rq->prio_group = 0;
+    rq->nr_ready = 0;
+    rq->nr_edf = 0;
+    rb_init(&rq->fair_tree);
+    rq->fair_leftmost = NULL;
+    rq->min_vruntime = 0;
+    rq->nr_fair = 0;
+}
+
+/**
+ * @brief Append a task to the tail of its priority queue, or add an EDF
+ * or fair task to the deadline heap or vruntime tree.
+ *
+ * Caller must hold the hart's lock.
+ */
+static void rq_enqueue(runqueue_t *rq, task_t *ptcb)
+{
+    uint8_t prio = ptcb->priority;
+
+    ptcb->on_rq = 1;
+
+    if (ptcb->policy == SCHED_EDF) {
+        edf_enqueue(rq, ptcb);
+        rq->nr_ready++;
+        return;
+    }
+    if (ptcb->policy == SCHED_FAIR) {
+        rq->nr_ready += fair_enqueue(rq, ptcb);
+        return;
+    }
+
+    list_insert_before(&rq->queue[prio], &ptcb->list);
+    rq->prio_map[prio >> 5] |= 1U << (prio & 31);
+    rq->prio_group |= 1U << (prio >> 5);
+    rq->nr_ready++;
+}
+
+/**
+ * @brief Unlink a queued task, clearing bitmap bits that become empty.
+ *
+ * Caller must hold the hart's lock.
+ */
+static void rq_dequeue(runqueue_t *rq, task_t *ptcb)
+{
+    uint8_t prio = ptcb->priority;
+
+    ptcb->on_rq = 0;
+
+    if (ptcb->policy == SCHED_EDF) {
+        edf_dequeue(rq, ptcb);
+        rq->nr_ready--;
+        return;
+    }
+    if (ptcb->policy == SCHED_FAIR) {
+        rq->nr_ready -= fair_dequeue(rq, ptcb);
+        return;
+    }
+
+    list_remove(&ptcb->list);
+    if (list_empty(&rq->queue[prio])) {
+        rq->prio_map[prio >> 5] &= ~(1U << (prio & 31));
+        if (rq->prio_map[prio >> 5] == 0)
+            rq->prio_group &= ~(1U << (prio >> 5));
+    }
+    rq->nr_ready--;
+}
+
+/**
+ * @brief Highest ready priority, or -1 if the queue is empty.
+ */
+static int rq_top_prio(runqueue_t *rq)
+{
+    if (rq->prio_group == 0)
+        return -1;
+
+    uint32_t group = __ffs32(rq->prio_group);
+    return (group << 5) | __ffs32(rq->prio_map[group]);
+}
+
+/**
+ * @brief Find the head of the highest-priority non-empty queue.
+ *
+ * Lower value means higher priority, so this is the lowest set bit of the
+ * group map followed by the lowest set bit of that group. A ready EDF task
+ * comes before all of them: the one with the earliest deadline. Fair tasks
+ * run only when no priority task is ready.
+ *
+ * @return The task, still queued, or NULL if no task is ready.
+ */
+static task_t *rq_peek(runqueue_t *rq)
+{
+    int prio = rq_top_prio(rq);
+
+    if (rq->nr_edf > 0)
+        return rq->edf_heap[0];
+    if (prio < 0)
+        return fair_pick(rq);
+    return list_entry(rq->queue[prio].next, task_t, list);
+}
+
+/**
+ * @brief Find the tail of the highest-priority non-empty queue.
+ *
+ * The owning hart takes work from the head of each FIFO; thieves take it
+ * from the other end, the task the owner would have run last. EDF tasks
+ * are never returned, they stay on the hart that admitted them. Without a
+ * priority task, the fair task with the largest vruntime is taken.
+ */
+static task_t *rq_peek_tail(runqueue_t *rq)
+{
+    int prio = rq_top_prio(rq);
+
+    if (prio < 0)
+        return fair_pick_last(rq);
+    return list_entry(rq->queue[prio].prev, task_t, list);
+}
+
+/**
+ * @brief Take this hart's lock with machine interrupts masked.
+ *
+ * The tick handler touches the ready queues from trap context, so task code
+ * must not be interrupted while it holds the lock. With interrupts masked
+ * the caller cannot migrate, so mycpu() stays valid until sched_unlock().
+ *
+ * @return Previous interrupt state for sched_unlock().
+ */
+static inline uint32_t sched_lock(void)
+{
+    uint32_t intr = intr_save();
+    acquire(&mycpu()->lock);
+    return intr;
+}
+
+static inline void sched_unlock(uint32_t intr)
+{
+    release(&mycpu()->lock);
+    intr_restore(intr);
+}
+
+/**
+ * @brief Lock the hart a task belongs to.
+ *
+ * A queued task can be stolen while we wait for the lock, so check that it
+ * still belongs to the hart once the lock is held. Call with interrupts
+ * masked.
+ */
+static struct cpu *task_cpu_lock(task_t *ptcb)
+{
+    while (1) {
+        struct cpu *c = &cpus[ptcb->cpu];
+        acquire(&c->lock);
+        if (c == &cpus[ptcb->cpu])
+            return c;
+        release(&c->lock);
+    }
+}
+
+/**
+ * @brief Take two harts' locks, lower hart first so two thieves cannot
+ * deadlock on each other.
+ */
+static void sched_double_lock(struct cpu *a, struct cpu *b)
+{
+    if (a > b) {
+        struct cpu *tmp = a;
+        a = b;
+        b = tmp;
+    }
+    acquire(&a->lock);
+    acquire(&b->lock);
+}
+
+/**
+ * @brief Take a queued task off this hart's ready queue and make it current.
+ *
+ * Caller must hold the hart's lock and switch to the task's context right
+ * after.
+ */
+static void task_dispatch(struct cpu *c, task_t *ptcb)
+{
+    /* A task that just migrated may still be saving on its old hart */
+    while (ptcb->ctx.on_cpu)
+        ;
+    ptcb->ctx.on_cpu = 1;
+
+    rq_dequeue(&c->rq, ptcb);
+    ptcb->state = TASK_RUNNING;
+    ptcb->time_slice = sched_quantum[ptcb->priority];
+    ptcb->exec_start = timer_now();
+    c->running = ptcb;
+
+    /* Have the timer interrupt when the job's budget runs out */
+    if (ptcb->policy == SCHED_EDF)
+        timer_wake_at(ptcb->exec_start + ptcb->edf.budget_left);
+}
+
+/* Order in which the classes run, indexed by enum sched_policy */
+static const uint8_t sched_class_rank[] = {
+    [SCHED_EDF] = 0,
+    [SCHED_PRIO] = 1,
+    [SCHED_FAIR] = 2,
+};
+
+/**
+ * @brief Whether task a should run before task b.
+ *
+ * EDF tasks run first, by earliest deadline; then priority tasks, by lower
+ * priority value; then fair tasks, by smaller vruntime.
+ */
+static inline int task_before(task_t *a, task_t *b)
+{
+    if (a->policy != b->policy)
+        return sched_class_rank[a->policy] < sched_class_rank[b->policy];
+
+    switch (a->policy) {
+    case SCHED_EDF:
+        return a->edf.abs_deadline < b->edf.abs_deadline;
+    case SCHED_FAIR:
+        return a->fair.vruntime < b->fair.vruntime;
+    default:
+        return a->priority < b->priority;
+    }
+}
+
+/**
+ * @brief Whether a fair task's group has used up its quota.
+ */
+static inline int task_throttled(task_t *ptcb)
+{
+    return ptcb->policy == SCHED_FAIR && ptcb->fair.group != NULL &&
+           ptcb->fair.group->throttled;
+}
+
+/**
+ * @brief Charge the CPU time since dispatch to an EDF or fair task.
+ *
+ * Caller must hold the hart's lock.
+ */
+static void task_account(task_t *ptcb, uint64_t now)
+{
+    if (ptcb->policy == SCHED_EDF)
+        edf_charge(ptcb, now);
+    else if (ptcb->policy == SCHED_FAIR)
+        fair_charge(&cpus[ptcb->cpu].rq, ptcb, now);
+}
+
+/**
+ * @brief Load signal used for balancing: queued tasks plus the running one.
+ *
+ * Read without the hart's lock when looking at other harts, so it is only
+ * a hint.
+ */
+static inline uint32_t cpu_load(struct cpu *c)
+{
+    return c->rq.nr_ready + (c->running != NULL);
+}
+
+/**
+ * @brief Wake an idle hart so it can steal from a busy one.
+ *
+ * Called after queueing behind a running task.
+ */
+static void sched_kick_idle(struct cpu *busy)
+{
+    for (uint32_t i = 0; i < MAXNUM_CPU; i++) {
+        struct cpu *c = &cpus[i];
+        if (c != busy && c->online && cpu_load(c) == 0) {
+            if (c != mycpu())
+                smp_send_ipi(i);
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Queue a READY task on the ready queue of its hart c.
+ *
+ * If that hart should run it before what it is running now (or is idle),
+ * flag a reschedule and kick it with a software interrupt; the local hart
+ * picks the flag up on its next trap exit.
+ *
+ * Caller must hold c->lock.
+ */
+static void task_enqueue(struct cpu *c, task_t *ptcb)
+{
+    rq_enqueue(&c->rq, ptcb);
+
+    if (c->running != NULL && !task_before(ptcb, c->running)) {
+        sched_kick_idle(c);
+        return;
+    }
+
+#ifdef CONFIG_PREEMPT
+    if (c->running != NULL)
+        c->need_resched = 1;
+#else
+    /* Deadlines cannot be met if a released job waits for a yield */
+    if (c->running != NULL && ptcb->policy == SCHED_EDF)
+        c->need_resched = 1;
+#endif
+    if (c != mycpu())
+        smp_send_ipi(ptcb->cpu);
+}
+
+/**
+ * @brief Hand a READY task to its hart without taking the hart's lock.
+ *
+ * The task is pushed on the hart's inbox, a lock-free LIFO that any hart
+ * or interrupt handler may push to and only the owning hart drains, so a
+ * wakeup never waits for a busy run queue. A remote hart is kicked with a
+ * software interrupt; the local hart drains its inbox on the next trap
+ * exit or scheduling decision.
+ */
+static void rq_post(task_t *ptcb)
+{
+    struct cpu *c = &cpus[ptcb->cpu];
+    task_t *head;
+
+    /* Push-only, so the compare-and-swap cannot suffer from ABA */
+    do {
+        head = c->inbox;
+        ptcb->wake_next = head;
+    } while (!atomic_cas(&c->inbox, head, ptcb));
+
+    if (c != mycpu())
+        smp_send_ipi(ptcb->cpu);
+}
+
+/**
+ * @brief Queue every task handed to this hart through its inbox.
+ *
+ * Caller must hold c->lock, c being the calling hart.
+ */
+static void rq_drain_inbox(struct cpu *c)
+{
+    task_t *stack, *fifo = NULL;
+
+    if (c->inbox == NULL)
+        return;
+
+    /* Take the whole stack at once, then reverse it to wakeup order */
+    stack = atomic_xchg_ptr(&c->inbox, NULL);
+    while (stack != NULL) {
+        task_t *ptcb = stack;
+        stack = ptcb->wake_next;
+        ptcb->wake_next = fifo;
+        fifo = ptcb;
+    }
+
+    while (fifo != NULL) {
+        task_t *ptcb = fifo;
+        fifo = ptcb->wake_next;
+        task_enqueue(c, ptcb);
+    }
+}
+
+/**
+ * @brief Make a task waiting in state from READY and hand it to its hart.
+ *
+ * The state change is a compare-and-swap, so of several racing wakers
+ * exactly one queues the task. Safe from any hart and from trap context,
+ * and takes no lock.
+ *
+ * @return 1 if this call woke the task, 0 if it was not waiting.
+ */
+static int task_wakeup(task_t *ptcb, state_t from)
+{
+    if (!atomic_cas(&ptcb->state, from, TASK_READY))
+        return 0;
+
+    rq_post(ptcb);
+    return 1;
+}
+
+/**
+ * @brief Steal one ready task for an idle hart.
+ *
+ * The victim is the online hart with the highest load that has a task
+ * waiting behind the one it runs. The stolen task is rebound to the thief
+ * and queued on its ready queue.
+ *
+ * Called without any lock, with interrupts masked. The victim is chosen
+ * from unlocked load figures and checked again under both locks.
+ *
+ * @return The stolen task, or NULL if no hart has work to spare. Either
+ *         way thief->lock is held on return.
+ */
+static task_t *sched_steal(struct cpu *thief)
+{
+    struct cpu *victim = NULL;
+    uint32_t victim_load = 1;
+    task_t *ptcb;
+
+    for (uint32_t i = 0; i < MAXNUM_CPU; i++) {
+        struct cpu *c = &cpus[i];
+        if (c == thief || !c->online || c->rq.nr_ready == c->rq.nr_edf)
+            continue;
+        if (cpu_load(c) > victim_load) {
+            victim = c;
+            victim_load = cpu_load(c);
+        }
+    }
+
+    if (victim == NULL) {
+        acquire(&thief->lock);
+        return NULL;
+    }
+
+    sched_double_lock(thief, victim);
+
+    ptcb = NULL;
+    if (victim->rq.nr_ready > victim->rq.nr_edf)
+        ptcb = rq_peek_tail(&victim->rq);
+    if (ptcb != NULL) {
+        rq_dequeue(&victim->rq, ptcb);
+        if (ptcb->policy == SCHED_FAIR)
+            fair_migrate(&victim->rq, &thief->rq, ptcb);
+        ptcb->cpu = thief - cpus;
+        rq_enqueue(&thief->rq, ptcb);
+    }
+
+    release(&victim->lock);
+    return ptcb;
+}
+
+/**
+ * @brief Switch from curr, already queued or waiting, to next, a task
+ * queued on this hart, or to the scheduler loop if next is NULL.
+ *
+ * Caller holds c->lock with interrupts masked (intr is the state to
+ * restore). Returns when curr is switched back in.
+ */
+static void task_switch(struct cpu *c, task_t *curr, task_t *next,
+                        uint32_t intr)
+{
+    ctx_t *to;
+
+    if (next != NULL) {
+        task_dispatch(c, next);
+        to = &next->ctx;
+    } else {
+        c->running = NULL;
+        to = &c->ctx_sched;
+    }
+
+    /* Interrupts stay masked until switch_to has moved mscratch */
+    release(&c->lock);
+
+    switch_to(&curr->ctx, to);
+
+    intr_restore(intr);
+}
+
+/**
+ * @brief Give up the CPU after the running task stopped being runnable.
+ *
+ * Caller holds c->lock with interrupts masked (intr is the state to
+ * restore), has charged curr's run time with task_account() and has
+ * already queued curr wherever it waits. Switches straight
+ * to the next ready task, or back to the scheduler loop, which may steal
+ * work or idle. Returns when curr is switched back in.
+ *
+ * A waker on another hart may have made curr READY again already and
+ * handed it to our inbox; if it is also the best task to run, it just
+ * keeps running.
+ */
+static void task_switch_out(struct cpu *c, task_t *curr, uint32_t intr)
+{
+    task_t *next;
+
+    rq_drain_inbox(c);
+
+    next = rq_peek(&c->rq);
+    if (next == curr) {
+        rq_dequeue(&c->rq, curr);
+        curr->state = TASK_RUNNING;
+        sched_unlock(intr);
+        return;
+    }
+
+    task_switch(c, curr, next, intr);
+}
+
+/**
+ * @brief Pick the online hart with the fewest ready tasks.
+ *
+ * Reads the queue lengths without the harts' locks: a hint is enough.
+ */
+static uint32_t sched_select_cpu(void)
+{
+    uint32_t best = r_tp();
+
+    for (uint32_t i = 0; i < MAXNUM_CPU; i++) {
+        if (cpus[i].online && cpus[i].rq.nr_ready < cpus[best].rq.nr_ready)
+            best = i;
+    }
+    return best;
+}
+
+/**
+ * @brief Park a task on a hart's sleep queue until mtime reaches deadline.
+ *
+ * Inserted after every sleeper due no later, FIFO on equal deadlines. The
+ * hart's timer is pulled in if the deadline is earlier than the next tick.
+ * Caller must hold c->lock and set the task's state.
+ */
+static void sleepq_insert(struct cpu *c, task_t *ptcb, uint64_t deadline)
+{
+    list_t *pos;
+
+    for (pos = c->sleepq.next; pos != &c->sleepq; pos = pos->next) {
+        if (list_entry(pos, task_t, timer_list)->wake_at > deadline)
+            break;
+    }
+    list_insert_before(pos, &ptcb->timer_list);
+    ptcb->wake_at = deadline;
+
+    timer_wake_at(deadline);
+}
 
 /* -------------------------------------------------------------------------- */
 /*                              Core Scheduler                                */
 /* -------------------------------------------------------------------------- */
 
 /**
- * @brief Initialize the scheduler subsystem.
+ * @brief Initialize the scheduler subsystem (boot hart only).
+ *
+ * - Initialize the per-priority ready queues of every hart.
+ * - Put every TCB on the free pool.
+ * - Bring the boot hart's own scheduler state up.
+ */
+void sched_init(void)
+{
+    for (int i = 0; i < MAXNUM_CPU; i++) {
+        spinlock_init(&cpus[i].lock, "cpu");
+        rq_init(&cpus[i].rq); /* Empty ready queues */
+        list_init(&cpus[i].sleepq);
+        cpus[i].inbox = NULL;
+        cpus[i].running = NULL;
+        cpus[i].need_resched = 0;
+        cpus[i].online = 0;
+        cpus[i].edf_util = 0;
+        cpus[i].edf_tasks = 0;
+        cpus[i].in_trap = 0;
+    }
+    spinlock_init(&pool_lock, "task_pool");
+    fair_init();
+
+    list_init(&task_pool);
+    list_init(&task_dead);
+    for (int i = 0; i < MAX_USER_TASKS; i++) {
+        task_list[i].taskID = i;
+        task_list[i].state = TASK_EXITED;
+        task_list[i].policy = SCHED_PRIO;
+        task_list[i].on_rq = 0;
+        list_insert_before(&task_pool, &task_list[i].list);
+    }
+
+    for (int i = 0; i < PRIO_LEVEL; i++)
+        sched_quantum[i] = TIME_SLICE;
+
+    sched_init_hart();
+}
+
+/**
+ * @brief Bring up the scheduler state of the calling hart.
+ *
+ * Points mscratch at this hart's scheduler context, so traps taken before
+ * the first switch have somewhere to save registers, and makes the hart
+ * eligible for new tasks. Must run before the hart enables interrupts.
+ */
+void sched_init_hart(void)
+{
+    struct cpu *c = mycpu();
+
+    w_mscratch((uint32_t) &c->ctx_sched);
+    c->online = 1;
+}
+
+/**
+ * @brief Set the time slice given to tasks of one priority level.
+ *
+ * Takes effect the next time such a task is dispatched.
+ *
+ * @return 0 on success, -1 if ticks is 0.
+ */
+uint32_t sched_set_quantum(uint8_t priority, uint32_t ticks)
+{
+    if (ticks == 0)
+        return -1;
+
+    sched_quantum[priority] = ticks;
+    return 0;
+}
+
+/**
+ * @brief The Core Scheduler Loop
+ * * Every hart runs this on its own ready queue, and it never returns.
+ * * It continuously:
+ * 1. Queues the tasks other harts handed over through the inbox, then
+ *    picks the highest-priority ready task (FIFO within a priority), or
+ *    steals one from the busiest hart when its own queue is empty.
+ * 2. Switches context from Scheduler -> User Task.
+ * 3. Waits for a User Task to switch back (User Task -> Scheduler).
+ *    task_yield() and the CONFIG_PREEMPT tick switch between tasks
+ *    directly, so the task that comes back is whatever c->running is by
+ *    then.
+ * 4. Puts that task back in the queue if it is still runnable and repeats.
+ */
+void schedule(void)
+{
+    struct cpu *c = mycpu();
+    task_t *next_task;
+    uint32_t intr;
+
+    while (1) {
+        intr = sched_lock();
+
+        rq_drain_inbox(c);
+        next_task = rq_peek(&c->rq);
+        if (next_task == NULL) {
+            release(&c->lock);
+            next_task = sched_steal(c);
+        }
+        if (next_task == NULL) {
+            /*
+             * Sleep with interrupts still masked: a pending interrupt
+             * ends wfi without trapping, so a wakeup IPI that lands after
+             * the check above is not lost. The trap is taken once
+             * interrupts are restored.
+             */
+            release(&c->lock);
+            timer_idle_enter();
+            asm volatile("wfi");  // Wait for interrupt to save power */
+            timer_idle_exit();
+            intr_restore(intr);
+            task_reap();
+            continue;
+        }
+
+        task_dispatch(c, next_task);
+
+        /* Interrupts stay masked until switch_to has moved mscratch */
+        release(&c->lock);
+
+        /* Switch context: Scheduler -> User Task */
+        switch_to(&c->ctx_sched, &next_task->ctx);
+
+        /* ------------------------------------------------------------ */
+        /* CPU EXECUTION RESUMES HERE WHEN A TASK SWITCHES BACK         */
+        /* ------------------------------------------------------------ */
+
+        acquire(&c->lock);
+
+        if (c->running != NULL) {
+            if (c->running->state == TASK_RUNNING) {
+                c->running->state = TASK_READY;
+                rq_enqueue(&c->rq, c->running);
+            }
+
+            /* Indicate we are back in Kernel Scheduler */
+            c->running = NULL;
+        }
+
+        sched_unlock(intr);
+    }
+}
+
+/**
+ * @brief Charge one tick to the running task.
+ *
+ * Called from timer_handler() in trap context. When the time slice runs
+ * out the switch itself is left to task_preempt() on the way out of the
+ * trap.
+ */
+void task_tick(void)
+{
+    struct cpu *c = mycpu();
+    task_t *curr = c->running;
+
+    if (curr == NULL || curr->policy == SCHED_EDF)
+        return;
+
+    /* A group out of quota is throttled even without CONFIG_PREEMPT */
+    if (curr->policy == SCHED_FAIR) {
+        acquire(&c->lock);
+        int throttled = fair_charge(&c->rq, curr, timer_now());
+        release(&c->lock);
+
+        if (throttled) {
+            c->need_resched = 1;
+            return;
+        }
+    }
+
+    if (curr->time_slice > 0)
+        curr->time_slice--;
+
+#ifdef CONFIG_PREEMPT
+    if (curr->time_slice == 0)
+        c->need_resched = 1;
+#endif
+}
+
+/**
+ * @brief Charge elapsed time to a running EDF task.
+ *
+ * Called from timer_handler() in trap context on every timer interrupt,
+ * not just on ticks, since task_dispatch() arms the timer for the moment
+ * the budget runs out. An exhausted job is throttled by task_preempt(),
+ * with or without CONFIG_PREEMPT. Only the running task's own EDF fields
+ * are touched, so no lock is needed.
  *
- * - Clear mscratch to 0 to handle the first context switch safely.
- * - Initialize the ready queue list head.
- * - Reset the task allocation index.
+ * @return When the running job's budget runs out, or WAKE_NEVER.
  */
-void sched_init(void)
+uint64_t task_charge(uint64_t now)
 {
-    w_mscratch(0); /* Ensure first switch_to sees NULL */
-    list_init((list_t *) &task_ready.list); /* Ready queue sentinel node */
-    task_idx = 0;                           /* Reset TCB index */
-    spinlock_init(&task_lock);
+    struct cpu *c = mycpu();
+    task_t *curr = c->running;
+
+    if (curr == NULL || curr->policy != SCHED_EDF)
+        return WAKE_NEVER;
+
+    if (edf_charge(curr, now)) {
+        curr->edf.flags |= EDF_THROTTLED;
+        c->need_resched = 1;
+        return WAKE_NEVER;
+    }
+    return now + curr->edf.budget_left;
 }
 
 /**
- * @brief The Core Scheduler Loop
- * * This function never returns. It continuously:
- * 1. Checks if there is a task in the ready queue.
- * 2. Switches context from Scheduler -> User Task.
- * 3. Waits for User Task to yield (switches back User Task -> Scheduler).
- * 4. Puts the yielded task back in the queue and repeats.
+ * @brief Preempt the running task from trap context.
+ *
+ * trap_vector has already saved the full register file into the running
+ * task's ctx. Tasks handed over through the inbox are queued first, which
+ * may ask for a reschedule. If a task of equal or higher priority is
+ * ready, the current task is put back at the tail of its queue and
+ * mscratch is pointed at the next task, so trap_vector returns straight
+ * into it. Otherwise the current task gets a fresh slice and keeps running.
+ *
+ * An EDF task that ran out of budget is parked on the sleep queue until its
+ * next release instead, and a fair task whose group ran out of quota is
+ * held on its group; the hart runs whatever is left, or idles.
+ *
+ * @param epc Address the current task resumes at.
  */
-void schedule(void)
+void task_preempt(uint32_t epc)
 {
-    task_t *next_task;
-    struct context *next_ctx;
-
-    while (1) {
-        acquire(&task_lock);
-
-        if (list_empty(&task_ready.list)) {
-            release(&task_lock);
-            asm volatile("wfi");  // Wait for interrupt to save power */
-            continue;
-        }
-
-        /* Pick next task from the head of the ready list */
-        next_task = list_entry(task_ready.list.next, task_t, list);
-        list_remove(&next_task->list);
+    struct cpu *c = mycpu();
+    task_t *curr = c->running;
+    task_t *next;
 
-        task_running = next_task;
-        next_task->state = TASK_RUNNING;
-        next_ctx = &next_task->ctx;
+    if (!c->need_resched && c->inbox == NULL)
+        return;
 
-        release(&task_lock);
+    /* Only tasks are preempted, never the scheduler loop itself */
+    if (curr == NULL || r_mscratch() != (uint32_t) &curr->ctx) {
+        c->need_resched = 0;
+        return;
+    }
 
-        /* Switch context: Scheduler -> User Task */
-        switch_to(&ctx_sched, next_ctx);
+    acquire(&c->lock);
 
-        /* ------------------------------------------------------------ */
-        /* CPU EXECUTION RESUMES HERE WHEN USER TASK CALLS task_yield() */
-        /* ------------------------------------------------------------ */
+    rq_drain_inbox(c);
+    if (!c->need_resched) {
+        release(&c->lock);
+        return;
+    }
+    c->need_resched = 0;
 
-        acquire(&task_lock);
+    task_account(curr, timer_now());
 
-        if (task_running != NULL) {
-            if (task_running->state == TASK_RUNNING) {
-                task_running->state = TASK_READY;
-                list_insert_before(&task_ready.list, &task_running->list);
-            }
+    if (curr->policy == SCHED_EDF && (curr->edf.flags & EDF_THROTTLED)) {
+        curr->state = TASK_SLEEPING;
+        sleepq_insert(c, curr, curr->edf.next_release);
+        next = rq_peek(&c->rq);
+    } else if (task_throttled(curr)) {
+        curr->state = TASK_READY;
+        rq_enqueue(&c->rq, curr); /* held on its group */
+        next = rq_peek(&c->rq);
 
-            /* Indicate we are back in Kernel Scheduler */
-            task_running = NULL;
+        /* Another hart refilled the group since we looked: keep running */
+        if (next == curr) {
+            rq_dequeue(&c->rq, curr);
+            curr->state = TASK_RUNNING;
+            curr->time_slice = sched_quantum[curr->priority];
+            release(&c->lock);
+            return;
+        }
+    } else {
+        next = rq_peek(&c->rq);
+        if (next == NULL || task_before(curr, next)) {
+            curr->time_slice = sched_quantum[curr->priority];
+            release(&c->lock);
+            return;
         }
+        curr->state = TASK_READY;
+        rq_enqueue(&c->rq, curr);
+    }
+
+    curr->ctx.pc = epc;
 
-        release(&task_lock);
+    if (next != NULL) {
+        task_dispatch(c, next);
+        w_mscratch((uint32_t) &next->ctx);
+    } else {
+        c->running = NULL;
+        w_mscratch((uint32_t) &c->ctx_sched);
     }
+
+    release(&c->lock);
 }
 
 /* -------------------------------------------------------------------------- */
 /*                          Task Control Block (TCB) */
 /* -------------------------------------------------------------------------- */
 
+/**
+ * @brief Return an exited task's stack to the heap and its TCB to the pool.
+ *
+ * The task must be off every queue, and its last hart must be done with
+ * its stack (ctx.on_cpu clear).
+ */
+static void put_task(task_t *ptcb)
+{
+    kfree(ptcb->stack_addr);
+    ptcb->stack_addr = NULL;
+
+    acquire_irqsave(&pool_lock);
+    list_insert_before(&task_pool, &ptcb->list);
+    release_irqrestore(&pool_lock);
+}
+
+/**
+ * @brief Leave an exited, detached task for task_reap().
+ *
+ * Call with interrupts masked.
+ */
+static void task_bury(task_t *ptcb)
+{
+    acquire(&pool_lock);
+    list_insert_before(&task_dead, &ptcb->list);
+    release(&pool_lock);
+}
+
+/**
+ * @brief Reclaim detached tasks that have exited.
+ *
+ * An exiting task cannot free the stack it is running on, so it is left on
+ * task_dead and reclaimed here, by the next task allocation or by an idle
+ * hart, once its hart has switched away from it.
+ */
+static void task_reap(void)
+{
+    acquire_irqsave(&pool_lock);
+
+    for (list_t *node = task_dead.next; node != &task_dead;) {
+        task_t *ptcb = list_entry(node, task_t, list);
+        node = node->next;
+
+        if (ptcb->ctx.on_cpu)
+            continue;
+
+        list_remove(&ptcb->list);
+        release(&pool_lock);
+        put_task(ptcb);
+        acquire(&pool_lock);
+
+        /* the list may have changed while unlocked */
+        node = task_dead.next;
+    }
+
+    release_irqrestore(&pool_lock);
+}
+
 /**
  * @brief Allocate a new task control block from the static task pool.
  *
- * @return Pointer to a TCB from task_list[].
+ * @return A free TCB from task_list[], or NULL if all are in use.
  */
 static task_t *get_task(void)
 {
-    acquire(&task_lock);
-    task_t *tcb = &task_list[task_idx];
-    task_idx = (task_idx + 1) & 0xFF; /* Wrap around at 256 */
-    release(&task_lock);
+    task_t *tcb = NULL;
+
+    task_reap();
+
+    acquire_irqsave(&pool_lock);
+    if (!list_empty(&task_pool)) {
+        tcb = list_entry(task_pool.next, task_t, list);
+        list_remove(&tcb->list);
+    }
+    release_irqrestore(&pool_lock);
+
     return tcb;
 }
 
+/**
+ * @brief First code every task runs.
+ *
+ * Calls the entry function with its parameter and exits the task if the
+ * entry function returns, so returning is a valid way to finish.
+ */
+static void task_start(void)
+{
+    task_t *self = current();
+
+    self->entry(self->parameter);
+    task_exit();
+}
+
 /**
  * @brief Initialize a new task.
  *
  * - Allocate stack memory
  * - Initialize TCB fields
- * - Set entry point (ra) and stack pointer (sp)
+ * - Set start point (ra) and stack pointer (sp)
  * - Insert task into initial state (not ready yet)
+ *
+ * @return The new task, or NULL if out of memory or TCBs.
  */
 task_t *task_init(const char *name,
                   taskFunc_t taskFunc,
@@ -129,11 +980,17 @@ task_t *task_init(const char *name,
                   size_t stack_size,
                   uint16_t priority)
 {
-    void *stack_start = (void *) kalloc(stack_size);
-    if (stack_start == NULL)
+    task_t *ptcb = get_task();
+    if (ptcb == NULL)
         return NULL;
 
-    task_t *ptcb = get_task();
+    void *stack_start = (void *) kalloc(stack_size);
+    if (stack_start == NULL) {
+        acquire_irqsave(&pool_lock);
+        list_insert_before(&task_pool, &ptcb->list);
+        release_irqrestore(&pool_lock);
+        return NULL;
+    }
 
     memcpy(ptcb->name, name, sizeof(ptcb->name));
     ptcb->entry = taskFunc;
@@ -144,16 +1001,114 @@ task_t *task_init(const char *name,
     ptcb->stack_addr = stack_start;
     ptcb->stack_size = stack_size;
 
-    /* Set initial context: ra = entry point, sp = top of stack */
-    ptcb->ctx.ra = (uint32_t) taskFunc;
+    /* Set initial context: ra = task_start, sp = top of stack */
+    ptcb->ctx.ra = (uint32_t) task_start;
     ptcb->ctx.sp = (uint32_t) (stack_start + stack_size);
 
+    /* First switch_to "returns" to task_start, interrupts enabled */
+    ptcb->ctx.mstatus = MSTATUS_MPP | MSTATUS_MPIE;
+    ptcb->ctx.frame = CTX_FRAME_VOLUNTARY;
+    ptcb->ctx.on_cpu = 0;
+
+    if (priority >= PRIO_LEVEL)
+        priority = PRIO_LEVEL - 1;
     ptcb->priority = priority;
+    ptcb->base_priority = priority;
     ptcb->state = TASK_INIT;
+    ptcb->cpu = r_tp();
+    ptcb->joiner = NULL;
+    ptcb->wake_next = NULL;
+    ptcb->on_rq = 0;
+    ptcb->policy = SCHED_PRIO;
+    ptcb->fair.group = NULL;
+    ptcb->fair.held = 0;
 
     /* Insert task as an isolated list node */
     list_init(&ptcb->list);
+    list_init(&ptcb->timer_list);
+    list_init(&ptcb->mutexes);
+    ptcb->blocked_on = NULL;
+
+    return ptcb;
+}
+
+/**
+ * @brief Initialize a periodic earliest-deadline-first task.
+ *
+ * Times are in mtime ticks (see TIMER_MS / TIMER_US). Every period a job
+ * is released that may use budget ticks of CPU and must finish within
+ * deadline ticks of its release; it ends the job with task_wait_period().
+ * The task is admitted on the first hart whose EDF utilization stays
+ * within EDF_MAX_UTIL, and never leaves that hart.
+ *
+ * @return The new task, or NULL if the parameters are inconsistent, no hart
+ *         can take the extra utilization, or out of memory or TCBs.
+ */
+task_t *task_init_edf(const char *name,
+                      taskFunc_t taskFunc,
+                      void *parameter,
+                      size_t stack_size,
+                      uint32_t period,
+                      uint32_t budget,
+                      uint32_t deadline)
+{
+    if (budget == 0 || budget > deadline || deadline > period ||
+        budget > 0x7FFFFFFF)
+        return NULL;
+
+    task_t *ptcb = task_init(name, taskFunc, parameter, stack_size, 0);
+    if (ptcb == NULL)
+        return NULL;
+
+    ptcb->policy = SCHED_EDF;
+    ptcb->edf.period = period;
+    ptcb->edf.budget = budget;
+    ptcb->edf.deadline = deadline;
+    ptcb->edf.misses = 0;
+    ptcb->edf.flags = 0;
+
+    uint32_t intr = intr_save();
+    int admitted = edf_admit(ptcb);
+    intr_restore(intr);
+
+    if (admitted < 0) {
+        ptcb->state = TASK_EXITED;
+        put_task(ptcb);
+        return NULL;
+    }
+    return ptcb;
+}
+
+/**
+ * @brief Initialize a task in the fair class.
+ *
+ * Fair tasks share the CPU time that EDF and priority tasks leave over, in
+ * proportion to their weight. priority 0..FAIR_PRIO_LEVEL-1 maps to the
+ * weights of nice -20..19. A task in a group also counts against the
+ * group's quota; group may be NULL.
+ *
+ * @return The new task, or NULL if out of memory or TCBs.
+ */
+task_t *task_init_fair(const char *name,
+                       taskFunc_t taskFunc,
+                       void *parameter,
+                       size_t stack_size,
+                       uint16_t priority,
+                       fair_group_t *group)
+{
+    if (priority >= FAIR_PRIO_LEVEL)
+        priority = FAIR_PRIO_LEVEL - 1;
+
+    task_t *ptcb = task_init(name, taskFunc, parameter, stack_size, priority);
+    if (ptcb == NULL)
+        return NULL;
 
+    /* vruntime starts at the hart's min_vruntime when first queued */
+    ptcb->policy = SCHED_FAIR;
+    ptcb->fair.vruntime = 0;
+    ptcb->fair.sum_exec = 0;
+    ptcb->fair.weight = fair_weight(priority);
+    ptcb->fair.group = group;
     return ptcb;
 }
 
@@ -163,49 +1118,475 @@ task_t *task_init(const char *name,
 
 /**
  * @brief Start a task by transitioning from INIT → SUSPEND → READY.
+ *
+ * The task is bound to the online hart with the shortest ready queue. An
+ * EDF task stays on the hart that admitted it and releases its first job.
  */
 void task_startup(task_t *ptcb)
 {
-    ptcb->state = TASK_SUSPEND;
+    /* Nothing else touches a task still in INIT */
+    if (ptcb->policy == SCHED_EDF)
+        edf_release(ptcb, timer_now());
+    else
+        ptcb->cpu = sched_select_cpu();
+
+    if (!atomic_cas(&ptcb->state, TASK_INIT, TASK_SUSPEND))
+        return;
+
     task_resume(ptcb);
 }
 
 /**
  * @brief Resume a suspended task and move it into the ready queue.
  *
+ * Takes no lock: the task goes through its hart's inbox, so this is safe
+ * from interrupt handlers and never waits for a remote hart.
+ *
  * @return 0 on success, -1 if task state is not SUSPEND.
  */
 uint32_t task_resume(task_t *ptcb)
 {
-    acquire(&task_lock);
+    if (!task_wakeup(ptcb, TASK_SUSPEND))
+        return -1;
+    return 0;
+}
+
+/**
+ * @brief Terminate the running task.
+ *
+ * Wakes a task blocked in task_join() on us, which then reclaims the TCB
+ * and stack. A detached task is queued for task_reap() instead. Never
+ * returns. Also reached when a task's entry function returns.
+ */
+void task_exit(void)
+{
+    uint32_t intr = sched_lock();
+    struct cpu *c = mycpu();
+    task_t *curr = c->running;
+    task_t *joiner;
+
+    task_account(curr, timer_now());
+    if (curr->policy == SCHED_EDF)
+        edf_retire(curr);
+    curr->state = TASK_EXITED;
+    smp_mb();
+
+    /* Whoever joins or detaches from now on sees JOIN_EXITED */
+    joiner = atomic_xchg_ptr(&curr->joiner, JOIN_EXITED);
+    if (joiner == JOIN_DETACHED)
+        task_bury(curr);
+    else if (joiner != NULL)
+        task_wakeup(joiner, TASK_BLOCKED);
+
+    task_switch_out(c, curr, intr);
+
+    panic("task_exit: exited task resumed");
+}
+
+/**
+ * @brief Wait for a task to exit, then reclaim its TCB and stack.
+ *
+ * Only one task may join a given task, and a detached task cannot be
+ * joined. The TCB must not be used after this returns.
+ *
+ * @return 0 on success, -1 if the task cannot be joined.
+ */
+uint32_t task_join(task_t *ptcb)
+{
+    uint32_t intr = sched_lock();
+    struct cpu *c = mycpu();
+    task_t *curr = c->running;
 
-    if (ptcb->state != TASK_SUSPEND) {
-        release(&task_lock);
+    if (ptcb == curr || ptcb->stack_addr == NULL) {
+        sched_unlock(intr);
         return -1;
     }
 
-    list_remove(&ptcb->list);
-    list_insert_before(&task_ready.list, &ptcb->list);
-    ptcb->state = TASK_READY;
+    /* Block first, so a wakeup from task_exit() cannot be missed */
+    task_account(curr, timer_now());
+    curr->state = TASK_BLOCKED;
+    if (atomic_cas(&ptcb->joiner, NULL, curr)) {
+        task_switch_out(c, curr, intr);
+    } else {
+        curr->state = TASK_RUNNING;
+        sched_unlock(intr);
+
+        /* Only a task that already exited unjoined is ours to reclaim */
+        if (!atomic_cas(&ptcb->joiner, JOIN_EXITED, curr))
+            return -1;
+    }
+
+    /* Its hart may still be switching away from it */
+    while (ptcb->ctx.on_cpu)
+        ;
+
+    put_task(ptcb);
+    return 0;
+}
+
+/**
+ * @brief Let a task be reclaimed as soon as it exits, without a join.
+ *
+ * @return 0 on success, -1 if the task is already being joined.
+ */
+uint32_t task_detach(task_t *ptcb)
+{
+    if (ptcb->stack_addr == NULL)
+        return -1;
+
+    if (atomic_cas(&ptcb->joiner, NULL, JOIN_DETACHED))
+        return 0;
+
+    /* Already exited: hand it to task_reap() */
+    if (atomic_cas(&ptcb->joiner, JOIN_EXITED, JOIN_DETACHED)) {
+        uint32_t intr = intr_save();
+        task_bury(ptcb);
+        intr_restore(intr);
+        return 0;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Set the priority a task is scheduled at right now.
+ *
+ * A queued task is moved to the tail of its new priority queue, which is
+ * O(1) thanks to the bitmap. Tasks in any other state, including one still
+ * in its hart's inbox, only have the field updated and are queued at the
+ * new level the next time they reach a ready queue.
+ * For a fair task the priority sets its weight.
+ *
+ * Leaves base_priority alone: priority inheritance boosts and restores a
+ * task through here.
+ */
+void sched_set_prio(task_t *ptcb, uint8_t priority)
+{
+    uint32_t intr = intr_save();
+    struct cpu *c = task_cpu_lock(ptcb);
+    int queued = ptcb->policy == SCHED_PRIO && ptcb->on_rq;
+
+    if (queued)
+        rq_dequeue(&c->rq, ptcb);
+
+    ptcb->priority = priority;
+    if (ptcb->policy == SCHED_FAIR)
+        ptcb->fair.weight = fair_weight(priority);
+
+    if (queued)
+        task_enqueue(c, ptcb);
+
+    release(&c->lock);
+    intr_restore(intr);
+}
+
+/**
+ * @brief Change the priority of a task.
+ *
+ * For a priority task this is its base priority: while it holds a kmutex
+ * that a more urgent task waits for, it keeps running at the inherited
+ * priority and drops to the new one on unlock.
+ *
+ * @return 0 on success, -1 if priority is out of range.
+ */
+uint32_t task_set_priority(task_t *ptcb, uint16_t priority)
+{
+    if (priority >= PRIO_LEVEL ||
+        (ptcb->policy == SCHED_FAIR && priority >= FAIR_PRIO_LEVEL))
+        return -1;
 
-    release(&task_lock);
+    if (ptcb->policy == SCHED_PRIO) {
+        kmutex_set_base_prio(ptcb, priority);
+    } else {
+        ptcb->base_priority = priority;
+        sched_set_prio(ptcb, priority);
+    }
     return 0;
 }
 
 /**
  * @brief Yield CPU from the current running task.
  *
- * This function performs a context switch from the User Task back to the
- * Kernel Scheduler Loop.
+ * Picks the next task itself and switches to it directly, instead of
+ * bouncing through the Kernel Scheduler Loop: one switch_to and one
+ * lock round trip per yield. Returns at once if no task of equal or
+ * higher priority is ready, since the scheduler would pick us again.
  *
  * @return 0
  */
 uint32_t task_yield(void)
 {
-    task_t *curr = task_running;
+    uint32_t intr = sched_lock();
+    struct cpu *c = mycpu();
+    task_t *curr = c->running;
+    task_t *next;
 
-    /* Switch context: User Task -> Scheduler */
-    switch_to(&curr->ctx, &ctx_sched);
+    task_account(curr, timer_now());
+
+    /* A task we just woke may be waiting in our inbox */
+    rq_drain_inbox(c);
+    next = rq_peek(&c->rq);
+    if (next == NULL || task_before(curr, next)) {
+        sched_unlock(intr);
+        return 0;
+    }
+
+    /* Switch context: User Task -> User Task (next is at the head) */
+    curr->state = TASK_READY;
+    rq_enqueue(&c->rq, curr);
+    task_switch_out(c, curr, intr);
 
     return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Blocking                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Block the running task until task_unblock(), or until mtime
+ * reaches deadline.
+ *
+ * Caller holds lk with interrupts masked (intr is the state to restore)
+ * and has already left the task where its waker will find it. lk is only
+ * released once the task is BLOCKED, so a wakeup that races with us is not
+ * lost: it puts the task back on the ready queue before it switches away.
+ * Returns with lk released and interrupts restored. The caller tells a
+ * timeout from a wakeup by its own bookkeeping.
+ *
+ * @param deadline When to give up waiting, or WAKE_NEVER.
+ */
+void task_block(spinlock_t *lk, uint64_t deadline, uint32_t intr)
+{
+    struct cpu *c = mycpu();
+    task_t *curr = c->running;
+
+    acquire(&c->lock);
+    task_account(curr, timer_now());
+    curr->state = TASK_BLOCKED;
+    if (deadline != WAKE_NEVER)
+        sleepq_insert(c, curr, deadline);
+    release(lk);
+
+    task_switch_out(c, curr, intr);
+
+    if (deadline == WAKE_NEVER)
+        return;
+
+    /* Woken early: leave the sleep queue of the hart we blocked on */
+    intr = intr_save();
+    acquire(&c->lock);
+    list_remove(&curr->timer_list);
+    release(&c->lock);
+    intr_restore(intr);
+}
+
+/**
+ * @brief Switch straight to a task just woken on this hart.
+ *
+ * For request/response handoff: the caller made next READY with
+ * task_unblock() and gives it the hart now rather than when it reaches
+ * the head of the ready queue; the caller goes back on the queue. Does
+ * nothing if next belongs to another hart, or if the caller or the head
+ * of the queue should run before it.
+ *
+ * Also does nothing in trap context: the running task's ctx then holds
+ * the frame of the code the trap interrupted, which a voluntary switch
+ * would overwrite. task_preempt() picks next up on the way out instead.
+ */
+void task_handoff(task_t *next)
+{
+    uint32_t intr = sched_lock();
+    struct cpu *c = mycpu();
+    task_t *curr = c->running;
+
+    if (c->in_trap) {
+        sched_unlock(intr);
+        return;
+    }
+
+    rq_drain_inbox(c);
+    if (next->cpu != r_tp() || !next->on_rq ||
+        (next->policy == SCHED_FAIR && next->fair.held) ||
+        task_before(curr, next) || task_before(rq_peek(&c->rq), next)) {
+        sched_unlock(intr);
+        return;
+    }
+
+    task_account(curr, timer_now());
+    curr->state = TASK_READY;
+    rq_enqueue(&c->rq, curr);
+    task_switch(c, curr, next, intr);
+}
+
+/**
+ * @brief Make a task blocked in task_block() READY again.
+ *
+ * Takes no lock, so it is safe from any hart and from trap context.
+ *
+ * @return 1 if the task was woken, 0 if it was not blocked.
+ */
+int task_unblock(task_t *ptcb)
+{
+    return task_wakeup(ptcb, TASK_BLOCKED);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Sleeping                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Put the running task to sleep until mtime reaches deadline.
+ *
+ * The task is parked on its hart's sleep queue, sorted by deadline, and
+ * costs no CPU until timer_handler() wakes it. The hart's timer is pulled
+ * in if the deadline is earlier than the next tick, so the wakeup is as
+ * precise as mtime rather than the tick. Returns at once if the deadline
+ * has already passed.
+ */
+void task_sleep_until(uint64_t deadline)
+{
+    uint32_t intr = sched_lock();
+    struct cpu *c = mycpu();
+    task_t *curr = c->running;
+
+    if (deadline <= timer_now()) {
+        sched_unlock(intr);
+        return;
+    }
+
+    task_account(curr, timer_now());
+    curr->state = TASK_SLEEPING;
+    sleepq_insert(c, curr, deadline);
+    task_switch_out(c, curr, intr);
+}
+
+/**
+ * @brief Sleep for a number of mtime ticks (see TIMER_MS / TIMER_US).
+ */
+void task_sleep_ticks(uint32_t ticks)
+{
+    task_sleep_until(timer_now() + ticks);
+}
+
+/**
+ * @brief End the current job of an EDF task and wait for the next release.
+ *
+ * A job that ends after its deadline is counted in edf.misses. If the next
+ * release is already due, the next job starts at once, released now.
+ * Does nothing for a task that is not EDF.
+ */
+void task_wait_period(void)
+{
+    uint32_t intr = sched_lock();
+    struct cpu *c = mycpu();
+    task_t *curr = c->running;
+    uint64_t now = timer_now();
+    task_t *next;
+
+    if (curr->policy != SCHED_EDF) {
+        sched_unlock(intr);
+        return;
+    }
+
+    task_account(curr, now);
+
+    if (now >= curr->edf.next_release) {
+        edf_release(curr, now);
+        timer_wake_at(now + curr->edf.budget_left);
+
+        /* The new deadline may no longer be the earliest */
+        next = rq_peek(&c->rq);
+        if (next == NULL || task_before(curr, next)) {
+            sched_unlock(intr);
+            return;
+        }
+        curr->state = TASK_READY;
+        rq_enqueue(&c->rq, curr);
+        task_switch_out(c, curr, intr);
+        return;
+    }
+
+    curr->edf.flags |= EDF_WAITING;
+    curr->state = TASK_SLEEPING;
+    sleepq_insert(c, curr, curr->edf.next_release);
+    task_switch_out(c, curr, intr);
+}
+
+/**
+ * @brief Wake every task on this hart whose deadline has passed.
+ *
+ * Called from timer_handler() in trap context. Also gives throttled
+ * bandwidth groups their quota back once their period is over.
+ *
+ * @return Deadline of the earliest task still asleep or group still
+ *         throttled, or WAKE_NEVER.
+ */
+uint64_t task_wake_expired(uint64_t now)
+{
+    struct cpu *c = mycpu();
+    uint64_t next = WAKE_NEVER;
+    uint64_t refill;
+    list_t held;
+
+    acquire(&c->lock);
+
+    while (!list_empty(&c->sleepq)) {
+        task_t *ptcb = list_entry(c->sleepq.next, task_t, timer_list);
+        if (ptcb->wake_at > now) {
+            next = ptcb->wake_at;
+            break;
+        }
+
+        list_remove(&ptcb->timer_list);
+
+        /* An EDF task waiting for its next job gets it now */
+        if (ptcb->policy == SCHED_EDF &&
+            (ptcb->edf.flags & (EDF_THROTTLED | EDF_WAITING)))
+            edf_release(ptcb, ptcb->wake_at);
+        /* A timed task_block() waits BLOCKED; a task woken already is not */
+        if (atomic_cas(&ptcb->state, TASK_SLEEPING, TASK_READY) ||
+            atomic_cas(&ptcb->state, TASK_BLOCKED, TASK_READY))
+            task_enqueue(c, ptcb);
+    }
+
+    /* Tasks held by a refilled group may belong to any hart */
+    refill = fair_unthrottle(now, &held);
+    while (!list_empty(&held)) {
+        task_t *ptcb = list_entry(held.next, task_t, list);
+        list_remove(&ptcb->list);
+        ptcb->on_rq = 0;
+        if (ptcb->cpu == r_tp())
+            task_enqueue(c, ptcb);
+        else
+            rq_post(ptcb);
+    }
+    if (refill < next)
+        next = refill;
+
+    release(&c->lock);
+    return next;
+}
+
+/**
+ * @brief Deadline of the earliest sleeper on this hart or throttled group
+ * refill, or WAKE_NEVER.
+ *
+ * Call with interrupts masked.
+ */
+uint64_t task_next_wakeup(void)
+{
+    struct cpu *c = mycpu();
+    uint64_t next;
+
+    acquire(&c->lock);
+    next = fair_next_refill();
+    if (!list_empty(&c->sleepq)) {
+        uint64_t wake = list_entry(c->sleepq.next, task_t, timer_list)->wake_at;
+        if (wake < next)
+            next = wake;
+    }
+    release(&c->lock);
+
+    return next;
 }
\ No newline at end of file
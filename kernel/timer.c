@@ -2,15 +2,75 @@
 #include "defs.h"
 #include "platform.h"
 #include "riscv.h"
+#include "spinlock.h"
 #include "types.h"
 
-uint32_t _tick = 0;
+/* Ticks since boot, written by hart 0 only, read through timer_ticks() */
+static uint64_t _tick;
+static seqlock_t tick_seq;
 
-void timer_load(int interval)
+/* mtime at which each hart's next periodic tick is due */
+static uint64_t tick_next[MAXNUM_CPU];
+/* current mtimecmp of each hart */
+static uint64_t timer_armed[MAXNUM_CPU];
+
+/* Read the 64-bit mtime on rv32: re-read if the high word moved */
+uint64_t timer_now(void)
+{
+    volatile uint32_t *mtime = (volatile uint32_t *) CLINT_MTIME;
+    uint32_t hi, lo;
+
+    do {
+        hi = mtime[1];
+        lo = mtime[0];
+    } while (hi != mtime[1]);
+
+    return ((uint64_t) hi << 32) | lo;
+}
+
+/**
+ * @brief System ticks since boot, from any hart or task.
+ *
+ * A 64-bit load is two loads on rv32; the seqlock retries one that hart 0
+ * split with an update instead of returning a torn value.
+ */
+uint64_t timer_ticks(void)
+{
+    uint64_t ticks;
+    uint32_t seq;
+
+    do {
+        seq = read_seqbegin(&tick_seq);
+        ticks = _tick;
+    } while (read_seqretry(&tick_seq, seq));
+
+    return ticks;
+}
+
+/*
+ * Program this hart's mtimecmp. Park the high word first so the compare
+ * cannot match on a half-written value.
+ */
+static void timer_set(uint64_t when)
 {
-    int id = r_mhartid();
+    volatile uint32_t *cmp = (volatile uint32_t *) CLINT_MTIMECMP(r_mhartid());
 
-    *(uint64_t *) CLINT_MTIMECMP(id) = *(uint64_t *) CLINT_MTIME + interval;
+    timer_armed[r_mhartid()] = when;
+    cmp[1] = 0xFFFFFFFF;
+    cmp[0] = (uint32_t) when;
+    cmp[1] = (uint32_t) (when >> 32);
+}
+
+/**
+ * @brief Make sure this hart's timer fires no later than when.
+ *
+ * Used when a task goes to sleep with a deadline that is earlier than
+ * what mtimecmp is armed for. Call with interrupts masked.
+ */
+void timer_wake_at(uint64_t when)
+{
+    if (when < timer_armed[r_mhartid()])
+        timer_set(when);
 }
 
 void timer_init()
@@ -19,7 +79,10 @@ void timer_init()
      * On reset, mtime is cleared to zero, but the mtimecmp registers
      * are not reset. So we have to init the mtimecmp manually.
      */
-    timer_load(SYSTEM_TICK);
+    if (r_mhartid() == 0)
+        seqlock_init(&tick_seq, "tick_seq");
+    tick_next[r_mhartid()] = timer_now() + SYSTEM_TICK;
+    timer_set(tick_next[r_mhartid()]);
 
     /* enable machine-mode timer interrupts. */
     w_mie(r_mie() | MIE_MTIE);
@@ -30,9 +93,10 @@ void timer_init()
 
 static void print_tick()
 {
-    uint32_t seconds = _tick % 60;
-    uint32_t minutes = (_tick / 60) % 60;
-    uint32_t hours = (_tick / 3600);
+    uint32_t uptime = (uint32_t) div64_u32(_tick, TICK_HZ);
+    uint32_t seconds = uptime % 60;
+    uint32_t minutes = (uptime / 60) % 60;
+    uint32_t hours = (uptime / 3600);
     kprintf("\r                   \r");
     if (hours < 10)
         kprintf("0");
@@ -45,9 +109,102 @@ static void print_tick()
     kprintf("%d", seconds);
 }
 
+/*
+ * Account for every tick period that has passed on this hart, one after a
+ * normal tick, more after a tickless idle stretch. Hart 0 keeps the time.
+ * The 32-bit division is exact as long as a hart never goes more than
+ * ~400s without a tick, which TICKLESS_MAX_IDLE guarantees.
+ *
+ * Returns the number of ticks accounted.
+ */
+static uint32_t tick_catch_up(uint64_t now)
+{
+    uint32_t id = r_mhartid();
+    uint32_t ticks;
+
+    if (now < tick_next[id])
+        return 0;
+
+    ticks = (uint32_t) (now - tick_next[id]) / SYSTEM_TICK + 1;
+    tick_next[id] += (uint64_t) ticks * SYSTEM_TICK;
+
+    if (id == 0) {
+        uint32_t in_second;
+
+        div64_u32_rem(_tick, TICK_HZ, &in_second);
+        write_seqlock(&tick_seq);
+        _tick += ticks;
+        write_sequnlock(&tick_seq);
+        if (in_second + ticks >= TICK_HZ)
+            print_tick();
+    }
+    return ticks;
+}
+
+/* Fire at the next periodic tick, or earlier for a sleeper on this hart */
+static void timer_rearm(uint64_t wake)
+{
+    uint64_t when = tick_next[r_mhartid()];
+
+    timer_set(wake < when ? wake : when);
+}
+
 void timer_handler()
 {
-    _tick++;
-    print_tick();
-    timer_load(SYSTEM_TICK);
-}
\ No newline at end of file
+    uint64_t now = timer_now();
+    uint64_t wake, budget;
+
+    if (tick_catch_up(now))
+        task_tick();
+    wake = task_wake_expired(now);
+    budget = task_charge(now);
+    timer_rearm(budget < wake ? budget : wake);
+}
+
+/**
+ * @brief Stop the periodic tick before an idle hart executes wfi.
+ *
+ * With CONFIG_TICKLESS, mtimecmp is moved out to the next event that needs
+ * this hart: the earliest sleeping task, the uptime clock on hart 0 and at
+ * most TICKLESS_MAX_IDLE ticks otherwise. A running task's quantum cannot
+ * expire while idle.
+ * Call with interrupts masked.
+ */
+void timer_idle_enter(void)
+{
+#ifdef CONFIG_TICKLESS
+    uint32_t id = r_mhartid();
+    uint64_t deadline = tick_next[id] + (TICKLESS_MAX_IDLE - 1) * SYSTEM_TICK;
+
+    if (id == 0) {
+        /* the tick that completes the current second */
+        uint32_t in_second;
+        div64_u32_rem(_tick, TICK_HZ, &in_second);
+        uint32_t left = TICK_HZ - in_second;
+        uint64_t second = tick_next[id] + (uint64_t) (left - 1) * SYSTEM_TICK;
+        if (second < deadline)
+            deadline = second;
+    }
+
+    uint64_t wake = task_next_wakeup();
+    if (wake < deadline)
+        deadline = wake;
+
+    timer_set(deadline);
+#endif
+}
+
+/**
+ * @brief Catch _tick up from mtime and resume the periodic tick.
+ *
+ * Called after wfi, still with interrupts masked. Re-arming mtimecmp in the
+ * future also clears a pending timer interrupt whose ticks were just
+ * accounted here.
+ */
+void timer_idle_exit(void)
+{
+#ifdef CONFIG_TICKLESS
+    tick_catch_up(timer_now());
+    timer_rearm(task_next_wakeup());
+#endif
+}
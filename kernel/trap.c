@@ -1,5 +1,6 @@
 #include "defs.h"
 #include "riscv.h"
+#include "task.h"
 #include "types.h"
 
 extern char trap_vector[];
@@ -11,18 +12,25 @@ void trap_init()
      * set the trap-vector base-address for machine-mode
      */
     w_mtvec((uint32_t) trap_vector);
+
+    /* software interrupts carry IPIs between harts */
+    w_mie(r_mie() | MIE_MSIE);
 }
 
 uint32_t trap_handler(uint32_t epc, uint32_t cause)
 {
     uint32_t return_pc = epc;
     uint32_t cause_code = cause & 0xfff;
+    struct cpu *c = mycpu();
+
+    /* Calls that would switch tasks voluntarily check this */
+    c->in_trap++;
 
     if (cause & 0x80000000) {
         /* Asynchronous trap - interrupt */
         switch (cause_code) {
         case 3:
-            kprintf("[trap] software interrupt\n");
+            smp_ipi_handler();
             break;
         case 7:
             timer_handler();
@@ -40,5 +48,10 @@ uint32_t trap_handler(uint32_t epc, uint32_t cause)
         return_pc += 4;  // skip faulting instruction (no C extension)
     }
 
+    c->in_trap--;
+
+    /* Leave the trap in another task if the tick asked for a switch */
+    task_preempt(return_pc);
+
     return return_pc;
 }
@@ -0,0 +1,195 @@
+#include "defs.h"
+#include "list.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "task.h"
+#include "types.h"
+#include "wait.h"
+
+/*
+ * Wait queues.
+ *
+ * A task that has to wait for something queues a struct waiter on its own
+ * stack and blocks with task_block(), which takes it off every ready
+ * queue. The waker unlinks the waiter under the queue's lock, marks it
+ * woken and makes the task READY with task_unblock(). The waiter never
+ * re-checks a condition on wakeup: whoever wakes it has already handed
+ * it what it was waiting for, through waiter.msg if need be.
+ */
+
+/**
+ * @brief Set up an empty wait queue.
+ *
+ * name labels its lock for the lock profiler (see spinlock_init()).
+ */
+void waitq_init(waitq_t *wq, const char *name)
+{
+    spinlock_init(&wq->lock, name);
+    list_init(&wq->waiters);
+}
+
+/**
+ * @brief Deadline for a timeout of ticks mtime ticks from now.
+ *
+ * Maps WAIT_FOREVER to WAKE_NEVER, for the calls that take a timeout.
+ */
+uint64_t waitq_deadline(uint32_t ticks)
+{
+    if (ticks == WAIT_FOREVER)
+        return WAKE_NEVER;
+    return timer_now() + ticks;
+}
+
+/**
+ * @brief Queue the running task's waiter on wq, without blocking yet.
+ *
+ * For callers that must drop another lock between queueing and sleeping,
+ * such as cond_wait(). Caller holds the lock that guards wq.
+ */
+void waitq_add(waitq_t *wq, struct waiter *w)
+{
+    w->task = mycpu()->running;
+    w->woken = 0;
+    list_insert_before(&wq->waiters, &w->node);
+}
+
+/**
+ * @brief Sleep on a waiter queued with waitq_add(), unless it was woken
+ * in the meantime.
+ *
+ * Caller holds lk, the lock that guards the queue, with interrupts masked
+ * (intr is the state to restore). Returns with lk released and interrupts
+ * restored.
+ *
+ * @param deadline mtime at which to give up, or WAKE_NEVER.
+ * @return 0 if woken by waitq_wake(), -1 on timeout.
+ */
+uint32_t waitq_sleep(spinlock_t *lk,
+                     struct waiter *w,
+                     uint64_t deadline,
+                     uint32_t intr)
+{
+    uint8_t woken;
+
+    if (w->woken) {
+        release(lk);
+        intr_restore(intr);
+        return 0;
+    }
+
+    task_block(lk, deadline, intr);
+
+    /* Only a waker can end an untimed wait */
+    if (deadline == WAKE_NEVER)
+        return 0;
+
+    /* The timer woke us, unless a waker got to w first */
+    intr = intr_save();
+    acquire(lk);
+    woken = w->woken;
+    if (!woken)
+        list_remove(&w->node);
+    release(lk);
+    intr_restore(intr);
+
+    return woken ? 0 : -1;
+}
+
+/**
+ * @brief Block the running task on wq with a waiter of the caller's.
+ *
+ * For objects with several wait queues under one lock: lk is the lock
+ * that guards wq, and the caller fills in w->msg if the waker needs it.
+ * Caller holds lk with interrupts masked (intr is the state to restore).
+ * Returns with lk released and interrupts restored.
+ *
+ * @param deadline mtime at which to give up, or WAKE_NEVER.
+ * @return 0 if woken by waitq_wake(), -1 on timeout.
+ */
+uint32_t waitq_block(waitq_t *wq,
+                     spinlock_t *lk,
+                     struct waiter *w,
+                     uint64_t deadline,
+                     uint32_t intr)
+{
+    waitq_add(wq, w);
+    return waitq_sleep(lk, w, deadline, intr);
+}
+
+/**
+ * @brief Block the running task on wq until it is woken or deadline passes.
+ *
+ * Caller holds wq->lock with interrupts masked (intr is the state to
+ * restore). Returns with the lock released and interrupts restored.
+ *
+ * @param deadline mtime at which to give up, or WAKE_NEVER.
+ * @return 0 if woken by waitq_wake_one() or waitq_wake_all(), -1 on timeout.
+ */
+uint32_t waitq_wait(waitq_t *wq, uint64_t deadline, uint32_t intr)
+{
+    struct waiter w;
+
+    return waitq_block(wq, &wq->lock, &w, deadline, intr);
+}
+
+/**
+ * @brief The task that has waited longest on wq, or NULL.
+ *
+ * Caller holds the lock that guards wq.
+ */
+struct waiter *waitq_first(waitq_t *wq)
+{
+    if (list_empty(&wq->waiters))
+        return NULL;
+    return list_entry(wq->waiters.next, struct waiter, node);
+}
+
+/**
+ * @brief Take w off its wait queue and wake its task.
+ *
+ * Caller holds the lock that guards the queue. Safe from trap context.
+ */
+void waitq_wake(struct waiter *w)
+{
+    task_t *ptcb = w->task;
+
+    list_remove(&w->node);
+
+    /* A timed-out waiter checks this under the lock we hold */
+    w->woken = 1;
+    task_unblock(ptcb);
+}
+
+/**
+ * @brief Wake the task that has waited longest on wq.
+ *
+ * Caller holds wq->lock. Safe from trap context.
+ *
+ * @return 1 if a task was woken, 0 if none was waiting.
+ */
+int waitq_wake_one(waitq_t *wq)
+{
+    struct waiter *w = waitq_first(wq);
+
+    if (w == NULL)
+        return 0;
+
+    waitq_wake(w);
+    return 1;
+}
+
+/**
+ * @brief Wake every task waiting on wq.
+ *
+ * Caller holds wq->lock. Safe from trap context.
+ *
+ * @return How many tasks were woken.
+ */
+uint32_t waitq_wake_all(waitq_t *wq)
+{
+    uint32_t n = 0;
+
+    while (waitq_wake_one(wq))
+        n++;
+    return n;
+}
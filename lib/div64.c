@@ -0,0 +1,39 @@
+#include "types.h"
+
+/**
+ * @brief Divide a 64-bit value by a 32-bit one, keeping the remainder.
+ *
+ * rv32 has no 64-bit divide and we link without libgcc, so the high word
+ * is divided with the hardware 32-bit divide and the low word is shifted
+ * in one bit at a time.
+ */
+uint64_t div64_u32_rem(uint64_t n, uint32_t d, uint32_t *rem)
+{
+    uint32_t hi = (uint32_t) (n >> 32);
+    uint32_t lo = (uint32_t) n;
+    uint32_t q_hi = hi / d;
+    uint32_t q_lo = 0;
+    uint32_t r = hi % d;
+
+    for (int i = 31; i >= 0; i--) {
+        /* r may not fit 32 bits after the shift if d > 2^31 */
+        uint32_t carry = r >> 31;
+
+        r = (r << 1) | ((lo >> i) & 1);
+        q_lo <<= 1;
+        if (carry || r >= d) {
+            r -= d;
+            q_lo |= 1;
+        }
+    }
+
+    *rem = r;
+    return ((uint64_t) q_hi << 32) | q_lo;
+}
+
+uint64_t div64_u32(uint64_t n, uint32_t d)
+{
+    uint32_t rem;
+
+    return div64_u32_rem(n, d, &rem);
+}
@@ -1,6 +1,10 @@
 #include <stdarg.h>
 #include <stddef.h>
 
+#include "defs.h"
+#include "riscv.h"
+#include "spinlock.h"
+
 extern int uart_putc(char);
 extern void uart_puts(char *);
 
@@ -107,6 +111,7 @@ static int _vsnprintf(char *out, size_t n, const char *s, va_list vl)
 }
 
 static char out_buf[1000];  // buffer for _vprintf()
+static spinlock_t pr_lock;  // serializes out_buf and the UART across harts
 
 static int _vprintf(const char *s, va_list vl)
 {
@@ -126,7 +131,9 @@ int kprintf(const char *s, ...)
     int res = 0;
     va_list vl;
     va_start(vl, s);
+    acquire_irqsave(&pr_lock);
     res = _vprintf(s, vl);
+    release_irqrestore(&pr_lock);
     va_end(vl);
     return res;
 }
@@ -0,0 +1,258 @@
+#include "defs.h"
+#include "rbtree.h"
+#include "types.h"
+
+/*
+ * Red-black tree with NULL leaves. Insertion and erase are the classic
+ * CLRS algorithms; erase tracks the parent of the replacement node since
+ * that node may be a NULL leaf.
+ */
+
+static inline int rb_is_black(struct rb_node *node)
+{
+    return node == NULL || node->color == RB_BLACK;
+}
+
+/* Put new where old hangs from its parent (or the root) */
+static void rb_replace_child(struct rb_root *root,
+                             struct rb_node *old,
+                             struct rb_node *new)
+{
+    struct rb_node *parent = old->parent;
+
+    if (parent == NULL)
+        root->node = new;
+    else if (parent->left == old)
+        parent->left = new;
+    else
+        parent->right = new;
+}
+
+static void rb_rotate_left(struct rb_root *root, struct rb_node *x)
+{
+    struct rb_node *y = x->right;
+
+    x->right = y->left;
+    if (y->left != NULL)
+        y->left->parent = x;
+    y->parent = x->parent;
+    rb_replace_child(root, x, y);
+    y->left = x;
+    x->parent = y;
+}
+
+static void rb_rotate_right(struct rb_root *root, struct rb_node *x)
+{
+    struct rb_node *y = x->left;
+
+    x->left = y->right;
+    if (y->right != NULL)
+        y->right->parent = x;
+    y->parent = x->parent;
+    rb_replace_child(root, x, y);
+    y->right = x;
+    x->parent = y;
+}
+
+/**
+ * @brief Rebalance after a node was linked with rb_link_node().
+ */
+void rb_insert_color(struct rb_node *node, struct rb_root *root)
+{
+    struct rb_node *parent, *gparent, *uncle;
+
+    while ((parent = node->parent) != NULL && parent->color == RB_RED) {
+        /* A red parent is never the root, so gparent exists */
+        gparent = parent->parent;
+
+        if (parent == gparent->left) {
+            uncle = gparent->right;
+            if (!rb_is_black(uncle)) {
+                parent->color = RB_BLACK;
+                uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->right) {
+                rb_rotate_left(root, parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->color = RB_BLACK;
+            gparent->color = RB_RED;
+            rb_rotate_right(root, gparent);
+        } else {
+            uncle = gparent->left;
+            if (!rb_is_black(uncle)) {
+                parent->color = RB_BLACK;
+                uncle->color = RB_BLACK;
+                gparent->color = RB_RED;
+                node = gparent;
+                continue;
+            }
+            if (node == parent->left) {
+                rb_rotate_right(root, parent);
+                node = parent;
+                parent = node->parent;
+            }
+            parent->color = RB_BLACK;
+            gparent->color = RB_RED;
+            rb_rotate_left(root, gparent);
+        }
+    }
+
+    root->node->color = RB_BLACK;
+}
+
+/* Restore the black height after a black node left the tree above x */
+static void rb_erase_fixup(struct rb_root *root,
+                           struct rb_node *x,
+                           struct rb_node *parent)
+{
+    struct rb_node *w;
+
+    while (x != root->node && rb_is_black(x)) {
+        if (x == parent->left) {
+            w = parent->right;
+            if (w->color == RB_RED) {
+                w->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_left(root, parent);
+                w = parent->right;
+            }
+            if (rb_is_black(w->left) && rb_is_black(w->right)) {
+                w->color = RB_RED;
+                x = parent;
+                parent = x->parent;
+                continue;
+            }
+            if (rb_is_black(w->right)) {
+                w->left->color = RB_BLACK;
+                w->color = RB_RED;
+                rb_rotate_right(root, w);
+                w = parent->right;
+            }
+            w->color = parent->color;
+            parent->color = RB_BLACK;
+            w->right->color = RB_BLACK;
+            rb_rotate_left(root, parent);
+        } else {
+            w = parent->left;
+            if (w->color == RB_RED) {
+                w->color = RB_BLACK;
+                parent->color = RB_RED;
+                rb_rotate_right(root, parent);
+                w = parent->left;
+            }
+            if (rb_is_black(w->left) && rb_is_black(w->right)) {
+                w->color = RB_RED;
+                x = parent;
+                parent = x->parent;
+                continue;
+            }
+            if (rb_is_black(w->left)) {
+                w->right->color = RB_BLACK;
+                w->color = RB_RED;
+                rb_rotate_left(root, w);
+                w = parent->left;
+            }
+            w->color = parent->color;
+            parent->color = RB_BLACK;
+            w->left->color = RB_BLACK;
+            rb_rotate_right(root, parent);
+        }
+        x = root->node;
+    }
+
+    if (x != NULL)
+        x->color = RB_BLACK;
+}
+
+/**
+ * @brief Unlink a node from the tree and rebalance.
+ */
+void rb_erase(struct rb_node *node, struct rb_root *root)
+{
+    struct rb_node *child, *parent;
+    uint32_t color;
+
+    if (node->left != NULL && node->right != NULL) {
+        /* Two children: the in-order successor takes node's place */
+        struct rb_node *succ = node->right;
+        while (succ->left != NULL)
+            succ = succ->left;
+
+        child = succ->right;
+        parent = succ->parent;
+        color = succ->color;
+
+        if (parent == node) {
+            parent = succ;
+        } else {
+            if (child != NULL)
+                child->parent = parent;
+            parent->left = child;
+            succ->right = node->right;
+            node->right->parent = succ;
+        }
+
+        succ->parent = node->parent;
+        succ->color = node->color;
+        succ->left = node->left;
+        node->left->parent = succ;
+        rb_replace_child(root, node, succ);
+    } else {
+        child = node->left != NULL ? node->left : node->right;
+        parent = node->parent;
+        color = node->color;
+
+        if (child != NULL)
+            child->parent = parent;
+        rb_replace_child(root, node, child);
+    }
+
+    if (color == RB_BLACK)
+        rb_erase_fixup(root, child, parent);
+}
+
+struct rb_node *rb_first(struct rb_root *root)
+{
+    struct rb_node *node = root->node;
+
+    if (node == NULL)
+        return NULL;
+    while (node->left != NULL)
+        node = node->left;
+    return node;
+}
+
+struct rb_node *rb_last(struct rb_root *root)
+{
+    struct rb_node *node = root->node;
+
+    if (node == NULL)
+        return NULL;
+    while (node->right != NULL)
+        node = node->right;
+    return node;
+}
+
+/**
+ * @brief In-order successor, or NULL for the last node.
+ */
+struct rb_node *rb_next(struct rb_node *node)
+{
+    struct rb_node *parent;
+
+    if (node->right != NULL) {
+        node = node->right;
+        while (node->left != NULL)
+            node = node->left;
+        return node;
+    }
+
+    while ((parent = node->parent) != NULL && node == parent->right)
+        node = parent;
+    return parent;
+}
@@ -1,4 +1,5 @@
 #include "vga.h"
+#include "atomic.h"
 #include "defs.h"
 #include "nyancat-frame.h"
 #include "types.h"
@@ -128,7 +129,7 @@ void vga_init()
 
     /* Ensure PCI configuration writes are committed before accessing I/O ports
      */
-    __asm__ volatile("fence w, o" ::: "memory");
+    io_wmb();
 
     /* Configure internal VGA registers for 320x200 graphics mode */
     set_mode13();
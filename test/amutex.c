@@ -0,0 +1,51 @@
+#include "atomic.h"
+#include "defs.h"
+#include "platform.h"
+#include "task.h"
+#include "types.h"
+#include "wait.h"
+
+/*
+ * Run with CPUS > 1. Four workers share one amutex: most sections are a
+ * few hundred cycles, but every 50th holds the mutex across a sleep. The
+ * short ones should be taken by spinning on the other harts; waiting out
+ * a sleeping owner should block instead. When all are done the checker
+ * prints the count (4 * 2000) and the decisions, e.g.
+ *   [amutex_test] count = 8000: fast ..., spun ..., blocked ...
+ * with both spun and blocked non-zero on SMP, and only fast and blocked
+ * with CPUS=1, where there is never a running owner to spin on.
+ */
+
+#define AM_WORKERS 4
+#define AM_ROUNDS 2000
+
+static amutex_t am;
+static volatile uint32_t count, done;
+
+static void am_worker(void *p)
+{
+    for (int i = 0; i < AM_ROUNDS; i++) {
+        amutex_lock(&am);
+        uint32_t tmp = count;
+        if (i % 50 == 0)
+            task_sleep_ticks(TIMER_MS(1));
+        else
+            for (volatile int j = 0; j < 50; j++)
+                ;
+        count = tmp + 1;
+        amutex_unlock(&am);
+    }
+
+    if (atomic_fetch_add(&done, 1) + 1 == AM_WORKERS)
+        kprintf("[amutex_test] count = %d: fast %d, spun %d, blocked %d\n",
+                count, am.fast, am.spun, am.blocked);
+}
+
+void amutex_test(void)
+{
+    amutex_init(&am, "amutex_test");
+    count = 0;
+    done = 0;
+    for (int i = 0; i < AM_WORKERS; i++)
+        task_startup(task_init("amw", am_worker, NULL, 1024, 11));
+}
@@ -0,0 +1,95 @@
+#include "defs.h"
+#include "riscv.h"
+#include "task.h"
+#include "types.h"
+#include "wait.h"
+
+#define BARRIER_ROUNDS 1000
+#define BARRIER_MAX_SLEEPERS 16
+
+/*
+ * Barrier latency against participant count. For each barrier kind and
+ * wait mode the driver starts n workers, which pass the barrier
+ * BARRIER_ROUNDS times; worker 0 times the run with mcycle and the
+ * driver prints cycles per phase:
+ *   [barrier_bench] central spin  n=2: ... cycles per barrier
+ * Spinning runs use one worker per online hart, up to all of them;
+ * sleeping runs go from 2 to BARRIER_MAX_SLEEPERS tasks whatever CPUS is.
+ * Compare across make run CPUS=1..8: the tree should pull ahead of the
+ * central barrier as participants grow.
+ */
+enum { KIND_CENTRAL, KIND_TREE, BARRIER_KINDS };
+
+static const char *kind_names[BARRIER_KINDS] = {"central", "tree"};
+
+static barrier_t central;
+static tbarrier_t tree;
+static uint32_t bench_kind;
+static volatile uint32_t bench_cycles;
+
+static void bench_pass(uint32_t id)
+{
+    if (bench_kind == KIND_CENTRAL)
+        barrier_wait(&central);
+    else
+        tbarrier_wait(&tree, id);
+}
+
+static void barrier_worker(void *p)
+{
+    uint32_t id = (uint32_t) p;
+
+    /* Line everybody up before the clock starts */
+    bench_pass(id);
+    uint32_t start = (uint32_t) r_mcycle();
+    for (int i = 0; i < BARRIER_ROUNDS; i++)
+        bench_pass(id);
+    if (id == 0)
+        bench_cycles = (uint32_t) r_mcycle() - start;
+}
+
+static void bench_run(uint32_t kind, uint32_t mode, uint32_t n)
+{
+    task_t *workers[BARRIER_MAX_SLEEPERS];
+
+    bench_kind = kind;
+    if (kind == KIND_CENTRAL)
+        barrier_init(&central, n, mode);
+    else if (tbarrier_init(&tree, n, mode) != 0)
+        return;
+
+    for (uint32_t i = 0; i < n; i++) {
+        workers[i] = task_init("barrier", barrier_worker, (void *) i, 1024,
+                               10);
+        task_startup(workers[i]);
+    }
+    for (uint32_t i = 0; i < n; i++)
+        task_join(workers[i]);
+
+    if (kind == KIND_TREE)
+        tbarrier_destroy(&tree);
+
+    kprintf("[barrier_bench] %s %s n=%d: %d cycles per barrier\n",
+            kind_names[kind], mode == BARRIER_SPIN ? "spin " : "sleep", n,
+            bench_cycles / BARRIER_ROUNDS);
+}
+
+static void barrier_driver(void *p)
+{
+    uint32_t harts = 0;
+
+    for (uint32_t i = 0; i < MAXNUM_CPU; i++)
+        harts += cpus[i].online;
+
+    for (uint32_t kind = 0; kind < BARRIER_KINDS; kind++) {
+        for (uint32_t n = 2; n <= harts; n++)
+            bench_run(kind, BARRIER_SPIN, n);
+        for (uint32_t n = 2; n <= BARRIER_MAX_SLEEPERS; n *= 2)
+            bench_run(kind, BARRIER_SLEEP, n);
+    }
+}
+
+void barrier_bench(void)
+{
+    task_startup(task_init("barrier_drv", barrier_driver, NULL, 1024, 11));
+}
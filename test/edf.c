@@ -0,0 +1,62 @@
+#include "defs.h"
+#include "platform.h"
+#include "task.h"
+#include "types.h"
+
+/*
+ * Two periodic EDF tasks with 30% and 50% utilization run next to a
+ * spinning priority task, which only gets the remaining 20%. A third EDF
+ * task asking for 50% must be rejected by admission control on a single
+ * hart. The control loops report their deadline misses, which should stay
+ * at zero.
+ */
+static void control_loop(void *p)
+{
+    task_t *self = (task_t *) p;
+    uint32_t jobs = 0;
+
+    while (1) {
+        /* Use most of the budget, as a control law computation would */
+        uint64_t until = timer_now() + self->edf.budget * 3 / 4;
+        while (timer_now() < until)
+            ;
+
+        if (++jobs % 50 == 0)
+            kprintf("[edf_test] %s: %d jobs, %d misses\n", self->name, jobs,
+                    self->edf.misses);
+        task_wait_period();
+    }
+}
+
+static void background(void *p)
+{
+    while (1)
+        ;
+}
+
+void edf_test(void)
+{
+    task_t *fast, *slow, *extra;
+
+    fast = task_init_edf("fast", control_loop, NULL, 1024, TIMER_MS(10),
+                         TIMER_MS(3), TIMER_MS(10));
+    slow = task_init_edf("slow", control_loop, NULL, 1024, TIMER_MS(50),
+                         TIMER_MS(20), TIMER_MS(40));
+    extra = task_init_edf("extra", control_loop, NULL, 1024, TIMER_MS(20),
+                          TIMER_MS(10), TIMER_MS(20));
+
+    if (extra == NULL) {
+        kprintf("[edf_test] admission rejected extra\n");
+    } else {
+        /* More harts, more capacity */
+        kprintf("[edf_test] extra admitted on hart %d\n", extra->cpu);
+        extra->parameter = extra;
+        task_startup(extra);
+    }
+
+    fast->parameter = fast;
+    slow->parameter = slow;
+    task_startup(fast);
+    task_startup(slow);
+    task_startup(task_init("background", background, NULL, 1024, 10));
+}
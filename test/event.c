@@ -0,0 +1,86 @@
+#include "defs.h"
+#include "platform.h"
+#include "task.h"
+#include "types.h"
+#include "wait.h"
+
+/*
+ * A three-stage pipeline without polling. The sampler sets SAMPLE_READY
+ * every 50ms; the filter waits for it, and the logger waits for both
+ * FILTERED and a 200ms HEARTBEAT bit (EVENT_ALL). Meanwhile four workers
+ * sleep on a condition variable until the sampler broadcasts a new
+ * generation, and each should report every generation exactly once.
+ */
+#define SAMPLE_READY (1U << 0)
+#define FILTERED (1U << 1)
+#define HEARTBEAT (1U << 2)
+
+static event_t pipeline;
+static kmutex_t gen_lock;
+static cond_t gen_cond;
+static uint32_t generation;
+
+static void sampler(void *p)
+{
+    for (uint32_t n = 1;; n++) {
+        task_sleep_ticks(TIMER_MS(50));
+        event_set(&pipeline, SAMPLE_READY);
+        if (n % 4 == 0)
+            event_set(&pipeline, HEARTBEAT);
+
+        kmutex_lock(&gen_lock);
+        generation = n;
+        cond_broadcast(&gen_cond);
+        kmutex_unlock(&gen_lock);
+    }
+}
+
+static void filter(void *p)
+{
+    while (1) {
+        event_wait(&pipeline, SAMPLE_READY, EVENT_ANY | EVENT_CLEAR,
+                   WAIT_FOREVER, NULL);
+        event_set(&pipeline, FILTERED);
+    }
+}
+
+static void logger(void *p)
+{
+    uint32_t got;
+
+    while (1) {
+        event_wait(&pipeline, FILTERED | HEARTBEAT, EVENT_ALL | EVENT_CLEAR,
+                   WAIT_FOREVER, &got);
+        kprintf("[event_test] heartbeat, flags 0x%x\n", got);
+    }
+}
+
+static void worker(void *p)
+{
+    uint32_t seen = 0;
+
+    while (1) {
+        kmutex_lock(&gen_lock);
+        while (generation == seen)
+            cond_wait(&gen_cond, &gen_lock);
+        if (generation != seen + 1)
+            kprintf("[event_test] ERROR: worker %d missed a generation\n",
+                    (uint32_t) p);
+        seen = generation;
+        kmutex_unlock(&gen_lock);
+    }
+}
+
+void event_test(void)
+{
+    event_init(&pipeline, "pipeline");
+    kmutex_init(&gen_lock);
+    cond_init(&gen_cond, "gen_cond");
+    generation = 0;
+
+    task_startup(task_init("sampler", sampler, NULL, 1024, 10));
+    task_startup(task_init("filter", filter, NULL, 1024, 11));
+    task_startup(task_init("logger", logger, NULL, 1024, 12));
+    for (uint32_t i = 0; i < 4; i++)
+        task_startup(task_init("worker", worker, (void *) i, 1024, 12));
+}
@@ -0,0 +1,58 @@
+#include "defs.h"
+#include "platform.h"
+#include "task.h"
+#include "types.h"
+
+/*
+ * Fair class demo. "spinner" burns 5ms before each yield and "yielder"
+ * yields at once, yet both should end up with about the same CPU time.
+ * "heavy" has three times their weight and should get about three times
+ * as much. "capped" belongs to a group limited to 20ms every 100ms and
+ * should stay at or below 20% of a hart. A priority task reports the CPU
+ * time each one got every second.
+ */
+static fair_group_t capped_group;
+static task_t *fair_tasks[4];
+
+static void spinner(void *p)
+{
+    while (1) {
+        uint64_t until = timer_now() + TIMER_MS(5);
+        while (timer_now() < until)
+            ;
+        task_yield();
+    }
+}
+
+static void yielder(void *p)
+{
+    while (1)
+        task_yield();
+}
+
+static void reporter(void *p)
+{
+    while (1) {
+        task_sleep_ticks(TIMER_MS(1000));
+        for (int i = 0; i < 4; i++) {
+            task_t *t = fair_tasks[i];
+            kprintf("[fair_test] %s: %d ms\n", t->name,
+                    (uint32_t) t->fair.sum_exec / TIMER_MS(1));
+        }
+    }
+}
+
+void fair_test(void)
+{
+    fair_group_init(&capped_group, TIMER_MS(20), TIMER_MS(100));
+
+    fair_tasks[0] = task_init_fair("spinner", spinner, NULL, 1024, 20, NULL);
+    fair_tasks[1] = task_init_fair("yielder", yielder, NULL, 1024, 20, NULL);
+    fair_tasks[2] = task_init_fair("heavy", spinner, NULL, 1024, 15, NULL);
+    fair_tasks[3] =
+        task_init_fair("capped", spinner, NULL, 1024, 20, &capped_group);
+
+    for (int i = 0; i < 4; i++)
+        task_startup(fair_tasks[i]);
+    task_startup(task_init("reporter", reporter, NULL, 1024, 10));
+}
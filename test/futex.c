@@ -0,0 +1,73 @@
+#include "atomic.h"
+#include "defs.h"
+#include "riscv.h"
+#include "task.h"
+#include "types.h"
+#include "wait.h"
+
+/*
+ * A mutex in one shared word, the way user code would build it on
+ * futexes: 0 free, 1 locked, 2 locked with sleepers. Taking a free lock
+ * or dropping one nobody waits for is a single AMO; only contention goes
+ * into the kernel. Workers bump a shared counter under it as in
+ * test/user2.c, yielding while they hold it so others pile up on the
+ * futex. Expected: "[futex_test] shared = 3000" once all are done.
+ */
+
+#define FUTEX_SPINS 100
+
+static volatile uint32_t flock;
+static volatile uint32_t shared, done;
+
+static void futex_lock(volatile uint32_t *l)
+{
+    uint32_t c = atomic_cmpxchg_acquire(l, 0, 1);
+
+    /* Spin a little: the holder may be just about to let go */
+    for (int i = 0; c != 0 && i < FUTEX_SPINS; i++) {
+        cpu_relax();
+        c = atomic_cmpxchg_acquire(l, 0, 1);
+    }
+
+    /* Still held: say there are sleepers and sleep until it is free */
+    if (c != 0) {
+        if (c != 2)
+            c = atomic_xchg_acquire(l, 2);
+        while (c != 0) {
+            kfutex_wait(l, 2, WAIT_FOREVER);
+            c = atomic_xchg_acquire(l, 2);
+        }
+    }
+}
+
+static void futex_unlock(volatile uint32_t *l)
+{
+    if (atomic_fetch_sub_release(l, 1) != 1) {
+        atomic_store_release(l, 0);
+        kfutex_wake(l, 1);
+    }
+}
+
+static void futex_worker(void *p)
+{
+    for (int i = 0; i < 1000; i++) {
+        futex_lock(&flock);
+        uint32_t tmp = shared;
+        if (i % 100 == 0)
+            task_yield();
+        shared = tmp + 1;
+        futex_unlock(&flock);
+    }
+
+    if (atomic_fetch_add(&done, 1) + 1 == 3)
+        kprintf("[futex_test] shared = %d\n", shared);
+}
+
+void futex_test(void)
+{
+    flock = 0;
+    shared = 0;
+    done = 0;
+    for (int i = 0; i < 3; i++)
+        task_startup(task_init("fw", futex_worker, NULL, 1024, 11));
+}
@@ -0,0 +1,73 @@
+#include "defs.h"
+#include "riscv.h"
+#include "task.h"
+#include "types.h"
+
+#define KB_SLOTS 256
+#define KB_ROUNDS 20000
+
+/*
+ * Allocation latency under fragmentation. A task keeps KB_SLOTS blocks of
+ * pseudo-random sizes (8..1024 bytes) alive and keeps replacing random
+ * ones, so the heap fills with holes. Each kalloc() and kfree() is timed
+ * with mcycle, and the average and worst case are printed:
+ *   [kalloc_bench] kalloc avg ... max ... cycles, kfree avg ... max ...
+ * Compare the default TLSF build with KALLOC_FIRSTFIT_ENABLE=1: first fit
+ * degrades as the free list grows, TLSF stays flat.
+ */
+
+static void *slots[KB_SLOTS];
+
+static uint32_t kb_rand(uint32_t *state)
+{
+    *state = *state * 1103515245U + 12345U;
+    return *state >> 8;
+}
+
+static void kalloc_bench_task(void *p)
+{
+    uint32_t seed = 1, fails = 0, frees = 0;
+    uint32_t a_max = 0, f_max = 0;
+    uint64_t a_sum = 0, f_sum = 0;
+
+    for (int i = 0; i < KB_ROUNDS; i++) {
+        uint32_t k = kb_rand(&seed) % KB_SLOTS;
+        uint32_t t;
+
+        if (slots[k] != NULL) {
+            t = (uint32_t) r_mcycle();
+            kfree(slots[k]);
+            t = (uint32_t) r_mcycle() - t;
+            f_sum += t;
+            frees++;
+            if (t > f_max)
+                f_max = t;
+        }
+
+        uint32_t size = 8 + kb_rand(&seed) % 1017;
+        t = (uint32_t) r_mcycle();
+        slots[k] = kalloc(size);
+        t = (uint32_t) r_mcycle() - t;
+        a_sum += t;
+        if (t > a_max)
+            a_max = t;
+        if (slots[k] == NULL)
+            fails++;
+    }
+
+    for (int k = 0; k < KB_SLOTS; k++) {
+        kfree(slots[k]);
+        slots[k] = NULL;
+    }
+
+    kprintf("[kalloc_bench] kalloc avg %d max %d cycles, kfree avg %d max %d\n",
+            (uint32_t) div64_u32(a_sum, KB_ROUNDS), a_max,
+            frees ? (uint32_t) div64_u32(f_sum, frees) : 0, f_max);
+    if (fails)
+        kprintf("[kalloc_bench] %d allocations failed\n", fails);
+}
+
+void kalloc_bench(void)
+{
+    task_startup(task_init("kalloc_bench", kalloc_bench_task, NULL, 1024, 10));
+}
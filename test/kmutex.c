@@ -0,0 +1,65 @@
+#include "defs.h"
+#include "platform.h"
+#include "task.h"
+#include "types.h"
+#include "wait.h"
+
+/*
+ * Classic priority inversion on one hart: "low" holds the shared buffer
+ * for 20ms at a time, "high" wants it periodically, and "medium" spins
+ * for 200ms whenever it wakes. Without inheritance, high waits for all
+ * of medium's spin; with it, low runs at high's priority while high
+ * waits, so the printed wait should stay around low's 20ms hold.
+ */
+static kmutex_t buf_lock;
+static task_t *low_task;
+
+static void busy(uint32_t ticks)
+{
+    uint64_t until = timer_now() + ticks;
+    while (timer_now() < until)
+        ;
+}
+
+static void low(void *p)
+{
+    while (1) {
+        kmutex_lock(&buf_lock);
+        busy(TIMER_MS(20));
+        kmutex_unlock(&buf_lock);
+        task_sleep_ticks(TIMER_MS(5));
+    }
+}
+
+static void medium(void *p)
+{
+    while (1) {
+        task_sleep_ticks(TIMER_MS(300));
+        busy(TIMER_MS(200));
+    }
+}
+
+static void high(void *p)
+{
+    while (1) {
+        task_sleep_ticks(TIMER_MS(150));
+
+        uint64_t start = timer_now();
+        kmutex_lock(&buf_lock);
+        uint32_t waited = (uint32_t) (timer_now() - start) / TIMER_US(1);
+        kmutex_unlock(&buf_lock);
+
+        kprintf("[kmutex_test] waited %d us, low back at priority %d\n",
+                waited, low_task->priority);
+    }
+}
+
+void kmutex_test(void)
+{
+    kmutex_init(&buf_lock);
+
+    low_task = task_init("low", low, NULL, 1024, 20);
+    task_startup(low_task);
+    task_startup(task_init("medium", medium, NULL, 1024, 10));
+    task_startup(task_init("high", high, NULL, 1024, 5));
+}
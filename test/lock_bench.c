@@ -0,0 +1,98 @@
+#include "atomic.h"
+#include "defs.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "task.h"
+#include "types.h"
+
+#define BENCH_ROUNDS 5000
+
+/*
+ * One worker per online hart hammers a shared counter under each kind of
+ * lock in turn: the old test-and-set flag, the ticket spinlock and the MCS
+ * queue lock. Workers start each round together and run with interrupts
+ * masked, so a holder is never preempted. Compare the printed cycles per
+ * acquire/release pair across make run CPUS=1..8.
+ */
+enum { LOCK_TAS, LOCK_TICKET, LOCK_MCS, LOCK_KINDS };
+
+static const char *lock_names[LOCK_KINDS] = {"test-and-set", "ticket", "mcs"};
+
+static volatile uint32_t tas_lock;
+static spinlock_t ticket_lock;
+static mcslock_t mcs_lock;
+
+static volatile uint32_t counter;
+static uint32_t nr_workers;
+static volatile uint32_t arrived[LOCK_KINDS];
+static volatile uint32_t finished[LOCK_KINDS];
+static volatile uint32_t cycles[LOCK_KINDS];
+
+static void bench_rounds(int kind)
+{
+    struct mcs_node node;
+
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        switch (kind) {
+        case LOCK_TAS:
+            while (atomic_xchg_acquire(&tas_lock, 1) != 0)
+                ;
+            counter++;
+            atomic_store_release(&tas_lock, 0);
+            break;
+        case LOCK_TICKET:
+            acquire(&ticket_lock);
+            counter++;
+            release(&ticket_lock);
+            break;
+        case LOCK_MCS:
+            mcs_acquire(&mcs_lock, &node);
+            counter++;
+            mcs_release(&mcs_lock, &node);
+            break;
+        }
+    }
+}
+
+static void bench_worker(void *p)
+{
+    for (int kind = 0; kind < LOCK_KINDS; kind++) {
+        /* Start together so every kind sees the same contention */
+        atomic_fetch_add_relaxed(&arrived[kind], 1);
+        while (arrived[kind] < nr_workers)
+            cpu_relax();
+
+        intr_push();
+        uint32_t start = (uint32_t) r_mcycle();
+        bench_rounds(kind);
+        uint32_t spent = (uint32_t) r_mcycle() - start;
+        intr_pop();
+
+        atomic_fetch_add_relaxed(&cycles[kind], spent);
+        if (atomic_fetch_add(&finished[kind], 1) + 1 != nr_workers)
+            continue;
+
+        kprintf("[lock_bench] %s: %d hart(s), %d cycles per lock/unlock\n",
+                lock_names[kind], nr_workers,
+                cycles[kind] / (nr_workers * BENCH_ROUNDS));
+        if (kind == LOCK_KINDS - 1 &&
+            counter != LOCK_KINDS * nr_workers * BENCH_ROUNDS)
+            kprintf("[lock_bench] ERROR: counter is %d\n", counter);
+    }
+}
+
+void lock_bench(void)
+{
+    tas_lock = 0;
+    spinlock_init(&ticket_lock, "lock_bench");
+    mcs_init(&mcs_lock);
+    counter = 0;
+
+    nr_workers = 0;
+    for (uint32_t i = 0; i < MAXNUM_CPU; i++)
+        nr_workers += cpus[i].online;
+
+    /* New tasks go to the shortest queue, so one lands on every hart */
+    for (uint32_t i = 0; i < nr_workers; i++)
+        task_startup(task_init("lockbench", bench_worker, NULL, 1024, 10));
+}
@@ -0,0 +1,87 @@
+#include "defs.h"
+#include "platform.h"
+#include "riscv.h"
+#include "task.h"
+#include "types.h"
+#include "wait.h"
+
+#define PINGS 1000
+
+/*
+ * A producer fills kalloc() buffers and passes them through a zero-copy
+ * queue to a consumer, which checks and frees them; the producer blocks
+ * whenever the 4-slot queue is full. A client and a server then
+ * ping-pong PINGS requests through two mailboxes. Every send switches
+ * straight to the waiting peer, so a round trip should cost two context
+ * switches and no trip through the scheduler loop.
+ */
+static msgq_t bufq;
+static mbox_t requests, replies;
+
+static void producer(void *p)
+{
+    for (uint32_t seq = 0;; seq++) {
+        uint32_t *buf = kalloc(64);
+        if (buf == NULL) {
+            task_sleep_ticks(TIMER_MS(10));
+            continue;
+        }
+        buf[0] = seq;
+        msgq_send_buf(&bufq, buf, WAIT_FOREVER);
+    }
+}
+
+static void consumer(void *p)
+{
+    uint32_t expect = 0;
+
+    while (1) {
+        uint32_t *buf;
+        msgq_recv_buf(&bufq, (void **) &buf, WAIT_FOREVER);
+        if (buf[0] != expect)
+            kprintf("[msgq_test] ERROR: got %d, expected %d\n", buf[0],
+                    expect);
+        expect = buf[0] + 1;
+        kfree(buf);
+
+        if (expect % 10000 == 0)
+            kprintf("[msgq_test] %d buffers passed\n", expect);
+    }
+}
+
+static void server(void *p)
+{
+    while (1) {
+        void *req;
+        mbox_recv(&requests, &req, WAIT_FOREVER);
+        mbox_send(&replies, (void *) ((uint32_t) req + 1), WAIT_FOREVER);
+    }
+}
+
+static void client(void *p)
+{
+    uint32_t start = (uint32_t) r_mcycle();
+
+    for (uint32_t i = 0; i < PINGS; i++) {
+        void *reply;
+        mbox_send(&requests, (void *) i, WAIT_FOREVER);
+        mbox_recv(&replies, &reply, WAIT_FOREVER);
+        if ((uint32_t) reply != i + 1)
+            kprintf("[msgq_test] ERROR: bad reply\n");
+    }
+
+    kprintf("[msgq_test] %d cycles per mailbox round trip\n",
+            ((uint32_t) r_mcycle() - start) / PINGS);
+}
+
+void msgq_test(void)
+{
+    msgq_init(&bufq, sizeof(void *), 4, "bufq");
+    mbox_init(&requests, "requests");
+    mbox_init(&replies, "replies");
+
+    task_startup(task_init("producer", producer, NULL, 1024, 12));
+    task_startup(task_init("consumer", consumer, NULL, 1024, 12));
+    task_startup(task_init("server", server, NULL, 1024, 10));
+    task_startup(task_init("client", client, NULL, 1024, 10));
+}
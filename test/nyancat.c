@@ -1,14 +1,10 @@
 #include "nyancat-frame.h"
+#include "atomic.h"
 #include "defs.h"
+#include "platform.h"
 #include "types.h"
 #include "vga.h"
 
-void delay(uint32_t count)
-{
-    for (volatile uint32_t i = 0; i < count; i++)
-        __asm__("nop");
-}
-
 void nyan_task(void *param)
 {
     volatile uint8_t *fb = (volatile uint8_t *) VGA_FB_BASE;
@@ -47,10 +43,10 @@ void nyan_task(void *param)
                 }
             }
 
-            __asm__ volatile("fence w, o" : : : "memory");
+            io_wmb();
 
             // Slow down the animation
-            delay(20000000);
+            task_sleep_ticks(TIMER_MS(100));
         }
     }
 }
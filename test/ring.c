@@ -0,0 +1,91 @@
+#include "atomic.h"
+#include "defs.h"
+#include "ring.h"
+#include "task.h"
+#include "types.h"
+
+#define MPMC_SIZE 64
+#define MPMC_PRODUCERS 2
+#define MPMC_ITEMS 20000
+
+/*
+ * An SPSC ring carries a counting sequence from one task to another; the
+ * consumer checks it arrives complete and in order. Two producers and two
+ * consumers share an MPMC ring; the consumers add up what they pop, and
+ * the total must match what was pushed. Neither side locks or masks
+ * interrupts, so the tasks can sit on any harts and be preempted
+ * anywhere. Run with CPUS > 1 to exercise the cross-hart ordering.
+ */
+SPSC_RING_DEFINE(seq_ring, 32);
+
+static struct mpmc_cell mpmc_cells[MPMC_SIZE];
+static mpmc_ring_t work_ring;
+static volatile uint32_t popped_sum, popped_count;
+
+static void spsc_producer(void *p)
+{
+    for (uint32_t n = 0;; n++) {
+        while (spsc_push(&seq_ring, n) != 0)
+            task_yield();
+    }
+}
+
+static void spsc_consumer(void *p)
+{
+    uint32_t expect = 0, v;
+
+    while (1) {
+        if (spsc_pop(&seq_ring, &v) != 0) {
+            task_yield();
+            continue;
+        }
+        if (v != expect)
+            kprintf("[ring_test] ERROR: spsc got %d, expected %d\n", v,
+                    expect);
+        expect = v + 1;
+        if (expect % 100000 == 0)
+            kprintf("[ring_test] spsc %d words in order\n", expect);
+    }
+}
+
+static void mpmc_producer(void *p)
+{
+    for (uint32_t n = 1; n <= MPMC_ITEMS; n++) {
+        while (mpmc_push(&work_ring, n) != 0)
+            task_yield();
+    }
+}
+
+static void mpmc_consumer(void *p)
+{
+    uint32_t v;
+
+    while (1) {
+        if (mpmc_pop(&work_ring, &v) != 0) {
+            task_yield();
+            continue;
+        }
+        atomic_fetch_add_relaxed(&popped_sum, v);
+        if (atomic_fetch_add(&popped_count, 1) + 1 ==
+            MPMC_PRODUCERS * MPMC_ITEMS) {
+            uint32_t want =
+                MPMC_PRODUCERS * (MPMC_ITEMS * (MPMC_ITEMS + 1) / 2);
+            kprintf("[ring_test] mpmc sum %s\n",
+                    popped_sum == want ? "ok" : "ERROR");
+        }
+    }
+}
+
+void ring_test(void)
+{
+    mpmc_init(&work_ring, mpmc_cells, MPMC_SIZE);
+    popped_sum = 0;
+    popped_count = 0;
+
+    task_startup(task_init("spsc_prod", spsc_producer, NULL, 1024, 10));
+    task_startup(task_init("spsc_cons", spsc_consumer, NULL, 1024, 10));
+    for (int i = 0; i < MPMC_PRODUCERS; i++)
+        task_startup(task_init("mpmc_prod", mpmc_producer, NULL, 1024, 10));
+    for (int i = 0; i < 2; i++)
+        task_startup(task_init("mpmc_cons", mpmc_consumer, NULL, 1024, 10));
+}
@@ -0,0 +1,63 @@
+#include "defs.h"
+#include "platform.h"
+#include "task.h"
+#include "types.h"
+#include "wait.h"
+
+/*
+ * A producer posts a semaphore every 100ms; the consumer blocks on it and
+ * should print each item with a latency far below the tick. A second
+ * consumer waits on a semaphore nobody posts with sem_timedwait() and
+ * should time out every 300ms. Both waiters use no CPU, so the spinning
+ * task below keeps the hart in between.
+ */
+static sem_t items;
+static sem_t never;
+static volatile uint64_t posted_at;
+
+static void producer(void *p)
+{
+    while (1) {
+        task_sleep_ticks(TIMER_MS(100));
+        posted_at = timer_now();
+        sem_post(&items);
+    }
+}
+
+static void consumer(void *p)
+{
+    uint32_t n = 0;
+
+    while (1) {
+        sem_wait(&items);
+        kprintf("[sem_test] item %d after %d us\n", ++n,
+                (uint32_t) (timer_now() - posted_at) / TIMER_US(1));
+    }
+}
+
+static void timed_waiter(void *p)
+{
+    while (1) {
+        if (sem_timedwait(&never, TIMER_MS(300)) == (uint32_t) -1)
+            kprintf("[sem_test] timed out\n");
+        else
+            kprintf("[sem_test] ERROR: got a unit nobody posted\n");
+    }
+}
+
+static void spinner(void *p)
+{
+    while (1)
+        ;
+}
+
+void sem_test(void)
+{
+    sem_init(&items, 0, "items");
+    sem_init(&never, 0, "never");
+
+    task_startup(task_init("producer", producer, NULL, 1024, 10));
+    task_startup(task_init("consumer", consumer, NULL, 1024, 10));
+    task_startup(task_init("timed", timed_waiter, NULL, 1024, 10));
+    task_startup(task_init("spinner", spinner, NULL, 1024, 11));
+}
@@ -0,0 +1,82 @@
+#include "defs.h"
+#include "platform.h"
+#include "spinlock.h"
+#include "task.h"
+#include "types.h"
+
+/*
+ * A writer keeps a 64-bit value and its complement in step, under a
+ * seqlock and under a rwlock. Readers on the other harts check that the
+ * two halves always match: a torn or half-updated read prints an ERROR.
+ * Readers of the seqlock never make the writer wait, so its update count
+ * should grow just as fast with readers running as without.
+ */
+static seqlock_t seq;
+static rwlock_t rw;
+static volatile uint64_t seq_val, seq_inv;
+static volatile uint64_t rw_val, rw_inv;
+
+static void writer(void *p)
+{
+    uint64_t n = 0;
+
+    while (1) {
+        n += 0x100000001ULL;
+
+        write_seqlock(&seq);
+        seq_val = n;
+        seq_inv = ~n;
+        write_sequnlock(&seq);
+
+        write_lock(&rw);
+        rw_val = n;
+        rw_inv = ~n;
+        write_unlock(&rw);
+
+        if ((uint32_t) n % 100000 == 0)
+            kprintf("[seqlock_test] %d updates\n", (uint32_t) n);
+    }
+}
+
+static void reader(void *p)
+{
+    uint32_t reads = 0;
+
+    while (1) {
+        uint64_t val, inv;
+        uint32_t s;
+
+        do {
+            s = read_seqbegin(&seq);
+            val = seq_val;
+            inv = seq_inv;
+        } while (read_seqretry(&seq, s));
+        if (val != ~inv)
+            kprintf("[seqlock_test] ERROR: torn seqlock read\n");
+
+        read_lock(&rw);
+        val = rw_val;
+        inv = rw_inv;
+        read_unlock(&rw);
+        if (val != ~inv)
+            kprintf("[seqlock_test] ERROR: torn rwlock read\n");
+
+        if (++reads % 100000 == 0)
+            kprintf("[seqlock_test] %d reads, %d ticks\n", reads,
+                    (uint32_t) timer_ticks());
+    }
+}
+
+void seqlock_test(void)
+{
+    seqlock_init(&seq, "seqlock_test");
+    rwlock_init(&rw);
+    seq_val = 0;
+    seq_inv = ~0ULL;
+    rw_val = 0;
+    rw_inv = ~0ULL;
+
+    task_startup(task_init("writer", writer, NULL, 1024, 10));
+    task_startup(task_init("reader", reader, NULL, 1024, 10));
+    task_startup(task_init("reader", reader, NULL, 1024, 10));
+}
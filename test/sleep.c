@@ -0,0 +1,34 @@
+#include "defs.h"
+#include "platform.h"
+#include "task.h"
+#include "types.h"
+
+/*
+ * Tasks pace themselves with task_sleep_ticks() instead of busy loops.
+ * The sleepers use no CPU, so the spinning task below should keep getting
+ * the hart between their wakeups, and the printed lateness should stay
+ * far below the 10ms tick.
+ */
+static void sleeper(void *p)
+{
+    uint32_t period = TIMER_MS(250);
+
+    while (1) {
+        uint64_t deadline = timer_now() + period;
+        task_sleep_until(deadline);
+        kprintf("[sleep_test] woke %d us late\n",
+                (uint32_t) (timer_now() - deadline) / TIMER_US(1));
+    }
+}
+
+static void spinner(void *p)
+{
+    while (1)
+        ;
+}
+
+void sleep_test(void)
+{
+    task_startup(task_init("sleeper", sleeper, NULL, 1024, 10));
+    task_startup(task_init("spinner", spinner, NULL, 1024, 11));
+}
@@ -25,7 +25,7 @@ void worker(void *p)
 void spinlock_test(void)
 {
     shared = 0;
-    spinlock_init(&lock);
+    spinlock_init(&lock, "spinlock_test");
     for (int i = 0; i < 3; i++)
         task_startup(task_init("w", worker, NULL, 1024, 11));
     // after some time, shared should equal 3 * 1000
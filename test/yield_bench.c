@@ -0,0 +1,39 @@
+#include "defs.h"
+#include "riscv.h"
+#include "task.h"
+#include "types.h"
+
+#define BENCH_YIELDS 10000
+
+/*
+ * Two tasks of the same priority ping-pong with task_yield(), so every
+ * call is one switch_to between them. Run this on a tree before and after
+ * a context switch change to compare cycles per yield.
+ */
+static void bench_task(void *p)
+{
+    uint32_t start = (uint32_t) r_mcycle();
+
+    for (int i = 0; i < BENCH_YIELDS; i++)
+        task_yield();
+
+    /* The window covers our yields and the partner's, 2 * BENCH_YIELDS */
+    uint32_t cycles = (uint32_t) r_mcycle() - start;
+    kprintf("[yield_bench] %d cycles per task_yield()\n",
+            cycles / (2 * BENCH_YIELDS));
+
+    while (1)
+        task_yield();
+}
+
+static void partner_task(void *p)
+{
+    while (1)
+        task_yield();
+}
+
+void yield_bench(void)
+{
+    task_startup(task_init("bench", bench_task, NULL, 1024, 10));
+    task_startup(task_init("partner", partner_task, NULL, 1024, 10));
+}